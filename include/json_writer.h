@@ -0,0 +1,217 @@
+// ---- Streamender JSON-Writer ----
+// Schreibt JSON direkt in einen festen Puffer und gibt ihn blockweise an eine
+// Senke weiter (z.B. WebServer::sendContent), sobald er voll ist. Es wird kein
+// Heap angefordert: der Speicherbedarf einer Antwort ist unabhängig von ihrer
+// Länge durch die Puffergröße begrenzt. Kommas zwischen Elementen setzt der
+// Writer selbst, Strings werden nach RFC 8259 maskiert.
+// Keine Arduino-Abhängigkeiten, damit der Writer auch auf dem Host läuft.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+class JsonWriter {
+ public:
+  typedef void (*Sink)(void* ctx, const char* data, size_t len);
+
+  // Maximale Schachtelungstiefe von Objekten und Arrays
+  static const uint8_t MAX_DEPTH = 32;
+
+  JsonWriter(char* buf, size_t size, Sink sink, void* ctx)
+      : buf_(buf), size_(size), len_(0), sink_(sink), ctx_(ctx), depth_(0), first_(0), afterKey_(false), bytes_(0) {}
+
+  void beginObject() { open('{'); }
+  void endObject() { close('}'); }
+  void beginArray() { open('['); }
+  void endArray() { close(']'); }
+
+  void key(const char* k) {
+    separator();
+    putString(k);
+    put(':');
+    afterKey_ = true;
+  }
+
+  void value(const char* s) {
+    separator();
+    if (s) putString(s);
+    else write("null", 4);
+  }
+  void value(bool b) {
+    separator();
+    if (b) write("true", 4);
+    else write("false", 5);
+  }
+  void value(int v) { value((long long)v); }
+  void value(long v) { value((long long)v); }
+  void value(unsigned int v) { value((unsigned long long)v); }
+  void value(unsigned long v) { value((unsigned long long)v); }
+  void value(long long v) {
+    separator();
+    if (v < 0) {
+      put('-');
+      putUnsigned(0ULL - (unsigned long long)v);
+    } else {
+      putUnsigned((unsigned long long)v);
+    }
+  }
+  void value(unsigned long long v) {
+    separator();
+    putUnsigned(v);
+  }
+  // Festkomma mit decimals Nachkommastellen wie String(v, decimals);
+  // NaN und Unendlich werden zu null, da JSON sie nicht kennt
+  void value(double v, uint8_t decimals) {
+    separator();
+    putFixed(v, decimals);
+  }
+  void null() {
+    separator();
+    write("null", 4);
+  }
+  // Bereits fertiges JSON unverändert übernehmen
+  void raw(const char* json) {
+    separator();
+    write(json, strlen(json));
+  }
+
+  // Kurzformen für "key":value
+  void field(const char* k, const char* v) { key(k); value(v); }
+  void field(const char* k, bool v) { key(k); value(v); }
+  void field(const char* k, int v) { key(k); value(v); }
+  void field(const char* k, long v) { key(k); value(v); }
+  void field(const char* k, unsigned int v) { key(k); value(v); }
+  void field(const char* k, unsigned long v) { key(k); value(v); }
+  void field(const char* k, long long v) { key(k); value(v); }
+  void field(const char* k, unsigned long long v) { key(k); value(v); }
+  void field(const char* k, double v, uint8_t decimals) { key(k); value(v, decimals); }
+
+  // Rest des Puffers an die Senke geben; am Ende einer Antwort aufrufen
+  void flush() {
+    if (len_ == 0) return;
+    sink_(ctx_, buf_, len_);
+    bytes_ += len_;
+    len_ = 0;
+  }
+
+  // Bisher insgesamt erzeugte Bytes
+  size_t bytes() const { return bytes_ + len_; }
+
+ private:
+  char* buf_;
+  size_t size_;
+  size_t len_;
+  Sink sink_;
+  void* ctx_;
+  uint8_t depth_;
+  uint32_t first_;     // Bit n: Ebene n hat noch kein Element
+  bool afterKey_;      // Wert folgt direkt auf einen Schlüssel, kein Komma
+  size_t bytes_;
+
+  void put(char c) {
+    if (len_ == size_) flush();
+    buf_[len_++] = c;
+  }
+
+  void write(const char* s, size_t n) {
+    while (n > 0) {
+      if (len_ == size_) flush();
+      size_t chunk = size_ - len_;
+      if (chunk > n) chunk = n;
+      memcpy(buf_ + len_, s, chunk);
+      len_ += chunk;
+      s += chunk;
+      n -= chunk;
+    }
+  }
+
+  void separator() {
+    if (afterKey_) {
+      afterKey_ = false;
+      return;
+    }
+    if (depth_ == 0) return;
+    uint32_t bit = 1UL << (depth_ - 1);
+    if (first_ & bit) first_ &= ~bit;
+    else put(',');
+  }
+
+  void open(char c) {
+    separator();
+    put(c);
+    if (depth_ < MAX_DEPTH) depth_++;
+    first_ |= 1UL << (depth_ - 1);
+  }
+
+  void close(char c) {
+    if (depth_ > 0) depth_--;
+    put(c);
+  }
+
+  void putString(const char* s) {
+    static const char hex[] = "0123456789abcdef";
+    put('"');
+    const char* run = s;
+    for (; *s; s++) {
+      unsigned char c = (unsigned char)*s;
+      if (c >= 0x20 && c != '"' && c != '\\') continue;
+      write(run, s - run);
+      run = s + 1;
+      put('\\');
+      switch (c) {
+        case '"':  put('"'); break;
+        case '\\': put('\\'); break;
+        case '\n': put('n'); break;
+        case '\r': put('r'); break;
+        case '\t': put('t'); break;
+        case '\b': put('b'); break;
+        case '\f': put('f'); break;
+        default:
+          write("u00", 3);
+          put(hex[c >> 4]);
+          put(hex[c & 0x0F]);
+      }
+    }
+    write(run, s - run);
+    put('"');
+  }
+
+  void putUnsigned(unsigned long long v) {
+    char tmp[20];
+    size_t n = 0;
+    do {
+      tmp[n++] = '0' + (char)(v % 10);
+      v /= 10;
+    } while (v > 0);
+    while (n > 0) put(tmp[--n]);
+  }
+
+  void putFixed(double v, uint8_t decimals) {
+    if (v != v || v > 1e300 || v < -1e300) {
+      write("null", 4);
+      return;
+    }
+    if (decimals > 9) decimals = 9;
+    unsigned long long scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    bool neg = v < 0;
+    double a = neg ? -v : v;
+    // Außerhalb des Festkomma-Bereichs (selten) über snprintf
+    if (a * scale >= 9.0e15) {
+      char tmp[32];
+      int n = snprintf(tmp, sizeof(tmp), "%.*f", decimals, v);
+      if (n > 0 && (size_t)n < sizeof(tmp)) write(tmp, n);
+      else write("null", 4);
+      return;
+    }
+    unsigned long long scaled = (unsigned long long)(a * scale + 0.5);
+    if (neg && scaled != 0) put('-');
+    putUnsigned(scaled / scale);
+    if (decimals == 0) return;
+    put('.');
+    unsigned long long frac = scaled % scale;
+    for (unsigned long long d = scale / 10; d > 0; d /= 10) put('0' + (char)(frac / d % 10));
+  }
+};
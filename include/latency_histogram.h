@@ -0,0 +1,71 @@
+// ---- Latenz-Histogramm ----
+// Feste, grob logarithmische Klassen in ms; Perzentile werden als Obergrenze der
+// Klasse geliefert, in der die gewünschte Anzahl Werte erreicht ist. Ab
+// DECAY_AT Werten werden alle Klassen halbiert, damit neue Messungen (z.B. nach
+// einem Baudratenwechsel) nach einigen hundert Polls wieder dominieren.
+// Keine Arduino-Abhängigkeiten.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+class LatencyHistogram {
+ public:
+  static const size_t BUCKETS = 24;
+  static const uint32_t DECAY_AT = 1000;
+
+  LatencyHistogram() { reset(); }
+
+  void reset() {
+    for (size_t i = 0; i < BUCKETS; i++) counts_[i] = 0;
+    total_ = 0;
+    max_ = 0;
+  }
+
+  void add(unsigned long ms) {
+    size_t i = 0;
+    while (i < BUCKETS - 1 && ms > bound(i)) i++;
+    counts_[i]++;
+    total_++;
+    if (ms > max_) max_ = ms;
+    if (total_ >= DECAY_AT) decay();
+  }
+
+  // p in Prozent (50, 95, 99); 0 solange keine Werte vorliegen
+  unsigned long percentile(uint8_t p) const {
+    if (total_ == 0) return 0;
+    uint32_t need = (uint32_t)(((uint64_t)total_ * p + 99) / 100);
+    if (need == 0) need = 1;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      sum += counts_[i];
+      if (sum >= need) return i == BUCKETS - 1 ? max_ : bound(i);
+    }
+    return max_;
+  }
+
+  uint32_t count() const { return total_; }
+  unsigned long max() const { return max_; }
+
+ private:
+  uint32_t counts_[BUCKETS];
+  uint32_t total_;
+  unsigned long max_;
+
+  // Klassenobergrenzen in ms, letzte Klasse ist offen
+  static unsigned long bound(size_t i) {
+    static const unsigned long bounds[BUCKETS - 1] = {
+      1, 2, 5, 10, 15, 20, 30, 40, 50, 60, 80, 100,
+      125, 150, 200, 250, 300, 400, 500, 750, 1000, 2000, 5000
+    };
+    return bounds[i];
+  }
+
+  void decay() {
+    total_ = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      counts_[i] = (counts_[i] + 1) / 2;
+      total_ += counts_[i];
+    }
+  }
+};
@@ -0,0 +1,60 @@
+// ---- Downsampling für Diagramme (Largest-Triangle-Three-Buckets) ----
+// Reduziert eine Zeitreihe auf höchstens threshold Punkte und erhält dabei die
+// Form der Kurve: erster und letzter Punkt bleiben, aus jedem Eimer dazwischen
+// wird der Punkt gewählt, der mit dem zuletzt gewählten Punkt und dem
+// Mittelwert des nächsten Eimers das größte Dreieck bildet.
+// Die gewählten Indizes werden aufsteigend an emit übergeben, es wird nichts
+// zwischengespeichert. Series braucht size_t size(), double x(i), double y(i);
+// x muss streng steigen, sonst sind Eimer und Dreiecksflächen bedeutungslos.
+// Keine Arduino-Abhängigkeiten.
+#pragma once
+
+#include <stddef.h>
+
+template <typename Series, typename Emit>
+size_t lttbSelect(const Series& s, size_t threshold, Emit& emit) {
+  size_t n = s.size();
+  if (threshold >= n || threshold < 3) {
+    for (size_t i = 0; i < n; i++) emit(i);
+    return n;
+  }
+
+  // Erster und letzter Punkt sind fest, der Rest verteilt sich auf threshold - 2 Eimer
+  double every = (double)(n - 2) / (threshold - 2);
+  size_t a = 0;
+  emit(a);
+  for (size_t bucket = 0; bucket < threshold - 2; bucket++) {
+    // Mittelwert des nächsten Eimers (beim letzten Eimer: der letzte Punkt)
+    size_t avgStart = (size_t)((bucket + 1) * every) + 1;
+    size_t avgEnd = (size_t)((bucket + 2) * every) + 1;
+    if (avgEnd > n) avgEnd = n;
+    if (avgStart >= avgEnd) avgStart = avgEnd - 1;
+    double avgX = 0, avgY = 0;
+    for (size_t i = avgStart; i < avgEnd; i++) {
+      avgX += s.x(i);
+      avgY += s.y(i);
+    }
+    avgX /= avgEnd - avgStart;
+    avgY /= avgEnd - avgStart;
+
+    // Punkt des aktuellen Eimers mit der größten Dreiecksfläche
+    size_t from = (size_t)(bucket * every) + 1;
+    size_t to = (size_t)((bucket + 1) * every) + 1;
+    if (to > n - 1) to = n - 1;
+    double ax = s.x(a), ay = s.y(a);
+    double maxArea = -1;
+    size_t next = from;
+    for (size_t i = from; i < to; i++) {
+      double area = (ax - avgX) * (s.y(i) - ay) - (ax - s.x(i)) * (avgY - ay);
+      if (area < 0) area = -area;
+      if (area > maxArea) {
+        maxArea = area;
+        next = i;
+      }
+    }
+    emit(next);
+    a = next;
+  }
+  emit(n - 1);
+  return threshold;
+}
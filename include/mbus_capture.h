@@ -0,0 +1,115 @@
+// ---- Mitschnitt roher M-Bus Telegramme ----
+// Ringpuffer mit festen Slots: jedes empfangene Telegramm wird unverändert samt
+// Zeitstempel abgelegt, das älteste wird überschrieben. Formatiert wird erst beim
+// Download, nicht bei jedem Poll.
+//
+// Binärformat (alle Zahlen little endian):
+//   Dateikopf:  "MBCP" | Version (1 Byte) | 3 Bytes reserviert
+//   je Record:  Unixzeit s (4) | millis (4) | Zähler-Index (1) | Empfangsstatus (1) |
+//               Länge (2) | Rohbytes
+// Unixzeit ist 0, solange keine NTP-Zeit vorliegt.
+// Keine Arduino-Abhängigkeiten: tools/mbus_replay.cpp liest dasselbe Format.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+const char MBUS_CAPTURE_MAGIC[4] = {'M', 'B', 'C', 'P'};
+const uint8_t MBUS_CAPTURE_VERSION = 1;
+const size_t MBUS_CAPTURE_FILE_HEADER_LEN = 8;
+const size_t MBUS_CAPTURE_RECORD_HEADER_LEN = 12;
+const size_t MBUS_CAPTURE_MAX_FRAME = 256;
+
+struct MBusCaptureRecord {
+  uint32_t unixTime;
+  uint32_t millis;
+  uint8_t meter;
+  uint8_t status;           // MBusRxStatus beim Ende des Empfangs
+  uint16_t len;
+  uint8_t data[MBUS_CAPTURE_MAX_FRAME];
+
+  // Record im Dateiformat in out schreiben, liefert die Länge
+  size_t serialize(uint8_t* out) const {
+    putU32(out, unixTime);
+    putU32(out + 4, millis);
+    out[8] = meter;
+    out[9] = status;
+    out[10] = len & 0xFF;
+    out[11] = len >> 8;
+    memcpy(out + MBUS_CAPTURE_RECORD_HEADER_LEN, data, len);
+    return MBUS_CAPTURE_RECORD_HEADER_LEN + len;
+  }
+
+  // Record aus dem Dateiformat lesen; 0 bei unvollständigen oder ungültigen Daten
+  size_t parse(const uint8_t* in, size_t avail) {
+    if (avail < MBUS_CAPTURE_RECORD_HEADER_LEN) return 0;
+    len = in[10] | (in[11] << 8);
+    if (len > MBUS_CAPTURE_MAX_FRAME || avail < MBUS_CAPTURE_RECORD_HEADER_LEN + len) return 0;
+    unixTime = getU32(in);
+    millis = getU32(in + 4);
+    meter = in[8];
+    status = in[9];
+    memcpy(data, in + MBUS_CAPTURE_RECORD_HEADER_LEN, len);
+    return MBUS_CAPTURE_RECORD_HEADER_LEN + len;
+  }
+
+ private:
+  static void putU32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+  }
+  static uint32_t getU32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+};
+
+inline size_t mbusCaptureFileHeader(uint8_t* out) {
+  memcpy(out, MBUS_CAPTURE_MAGIC, 4);
+  out[4] = MBUS_CAPTURE_VERSION;
+  out[5] = out[6] = out[7] = 0;
+  return MBUS_CAPTURE_FILE_HEADER_LEN;
+}
+
+inline bool mbusCaptureCheckHeader(const uint8_t* in, size_t avail) {
+  return avail >= MBUS_CAPTURE_FILE_HEADER_LEN && memcmp(in, MBUS_CAPTURE_MAGIC, 4) == 0 &&
+         in[4] == MBUS_CAPTURE_VERSION;
+}
+
+// Schreiben und Lesen müssen vom Aufrufer gegeneinander gesperrt werden.
+// Records werden über eine fortlaufende Nummer adressiert; gültig sind
+// die Nummern [first(), end()).
+template <size_t N>
+class MBusCaptureRing {
+ public:
+  MBusCaptureRing() : count_(0) {}
+
+  void add(uint32_t unixTime, uint32_t ms, uint8_t meter, uint8_t status, const uint8_t* data, size_t len) {
+    MBusCaptureRecord& r = slots_[count_ % N];
+    if (len > MBUS_CAPTURE_MAX_FRAME) len = MBUS_CAPTURE_MAX_FRAME;
+    r.unixTime = unixTime;
+    r.millis = ms;
+    r.meter = meter;
+    r.status = status;
+    r.len = (uint16_t)len;
+    memcpy(r.data, data, len);
+    count_++;
+  }
+
+  uint32_t first() const { return count_ > N ? count_ - N : 0; }
+  uint32_t end() const { return count_; }
+  size_t size() const { return count_ > N ? N : count_; }
+  size_t capacity() const { return N; }
+
+  // false, wenn seq nicht (mehr) im Ring liegt
+  bool get(uint32_t seq, MBusCaptureRecord& out) const {
+    if (seq < first() || seq >= count_) return false;
+    out = slots_[seq % N];
+    return true;
+  }
+
+  void clear() { count_ = 0; }
+
+ private:
+  MBusCaptureRecord slots_[N];
+  uint32_t count_;
+};
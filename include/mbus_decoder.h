@@ -0,0 +1,498 @@
+// ---- M-Bus Long-Frame Decoder (EN 13757-2/-3) ----
+// Validiert ein RSP_UD Telegramm einmal (Start, L-Feld, Checksumme, Stop) und
+// läuft danach in einem Durchgang über die DIF/DIFE/VIF/VIFE Kette.
+// Zero-Copy: Records zeigen direkt in den Empfangspuffer, es wird kein String gebaut.
+// Keine Arduino-Abhängigkeiten, damit der Decoder auch auf dem Host (g++)
+// gegen mitgeschnittene Telegramme getestet und gebenchmarkt werden kann.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mbus_tables.h"
+
+// ---- Frame-Konstanten ----
+const uint8_t MBUS_FRAME_ACK = 0xE5;
+const uint8_t MBUS_FRAME_SHORT_START = 0x10;
+const uint8_t MBUS_FRAME_LONG_START = 0x68;
+const uint8_t MBUS_FRAME_STOP = 0x16;
+const uint8_t MBUS_CI_RSP_UD_LONG = 0x72;  // Variable Datenstruktur, langer Header (12 Bytes)
+const uint8_t MBUS_CI_RSP_UD_SHORT = 0x7A; // Variable Datenstruktur, kurzer Header (4 Bytes)
+const uint8_t MBUS_MAX_DIFE = 10;
+const uint8_t MBUS_MAX_VIFE = 10;
+
+enum MBusDecodeResult {
+  MBUS_DECODE_OK = 0,
+  MBUS_DECODE_TOO_SHORT,       // weniger Bytes als das L-Feld verlangt
+  MBUS_DECODE_BAD_START,       // kein 0x68 L L 0x68 gefunden
+  MBUS_DECODE_BAD_LENGTH,      // L-Felder ungleich oder zu klein
+  MBUS_DECODE_BAD_CHECKSUM,
+  MBUS_DECODE_BAD_STOP,
+  MBUS_DECODE_UNSUPPORTED_CI,
+  MBUS_DECODE_BAD_RECORD,      // Record-Kette ragt über das Telegramm hinaus
+  MBUS_DECODE_NO_VOLUME        // Frame gültig, aber kein Volumen-Record
+};
+
+inline const char* mbusDecodeResultText(MBusDecodeResult r) {
+  switch (r) {
+    case MBUS_DECODE_OK:             return "OK";
+    case MBUS_DECODE_TOO_SHORT:      return "Telegramm zu kurz";
+    case MBUS_DECODE_BAD_START:      return "kein Startzeichen";
+    case MBUS_DECODE_BAD_LENGTH:     return "L-Feld ungueltig";
+    case MBUS_DECODE_BAD_CHECKSUM:   return "Checksumme falsch";
+    case MBUS_DECODE_BAD_STOP:       return "kein Stopzeichen";
+    case MBUS_DECODE_UNSUPPORTED_CI: return "CI-Feld nicht unterstuetzt";
+    case MBUS_DECODE_BAD_RECORD:     return "Datenrecord defekt";
+    case MBUS_DECODE_NO_VOLUME:      return "kein Volumenwert";
+  }
+  return "?";
+}
+
+// ---- Validierter Long Frame ----
+struct MBusFrame {
+  uint8_t c;
+  uint8_t a;
+  uint8_t ci;
+  // Fester Header (bei CI 0x7A nur accessNo/status/signature gültig)
+  uint32_t id;              // Seriennummer, BCD-dekodiert
+  uint16_t manufacturer;
+  uint8_t version;
+  uint8_t medium;
+  uint8_t accessNo;
+  uint8_t status;
+  uint16_t signature;
+  // Datenrecords hinter dem Header
+  const uint8_t* records;
+  size_t recordsLen;
+  size_t frameLen;          // Gesamtlänge inkl. Start und Stop
+};
+
+// BCD (LSB zuerst) -> Binär. Liefert false bei Nibbles > 9.
+inline bool mbusBcdToUInt(const uint8_t* p, uint8_t len, uint64_t& out) {
+  uint64_t value = 0;
+  for (int i = len - 1; i >= 0; i--) {
+    uint8_t hi = p[i] >> 4;
+    uint8_t lo = p[i] & 0x0F;
+    if (hi > 9 || lo > 9) return false;
+    value = value * 100 + hi * 10 + lo;
+  }
+  out = value;
+  return true;
+}
+
+// Prüft einen Langrahmen ab p (p[0] == 0x68): Kopf, Länge, Prüfsumme, Stopzeichen
+inline MBusDecodeResult mbusCheckLongFrame(const uint8_t* p, size_t avail) {
+  if (avail < 4 || p[3] != MBUS_FRAME_LONG_START) return MBUS_DECODE_BAD_START;
+  uint8_t l = p[1];
+  if (p[2] != l || l < 3) return MBUS_DECODE_BAD_LENGTH;
+  if (avail < (size_t)l + 6) return MBUS_DECODE_TOO_SHORT;
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < l; i++) sum += p[4 + i];
+  if (sum != p[4 + l]) return MBUS_DECODE_BAD_CHECKSUM;
+  if (p[5 + l] != MBUS_FRAME_STOP) return MBUS_DECODE_BAD_STOP;
+  return MBUS_DECODE_OK;
+}
+
+// Sucht den ersten gültigen Rahmen 0x68 L L 0x68 ... 0x16 im Puffer. Pegelwandler
+// liefern teilweise das Echo des eigenen Polls vorneweg, und darin kann 0x68 als
+// Adresse oder Prüfsumme vorkommen (z.B. Adresse 13 mit FCB=0 hat Prüfsumme 0x68):
+// ein Kandidat, der die Prüfung nicht besteht, wird übersprungen. Gemeldet wird
+// der Fehler des ersten Kandidaten mit gültigem Kopf, sonst BAD_START.
+inline MBusDecodeResult mbusParseLongFrame(const uint8_t* buf, size_t len, MBusFrame& frame) {
+  if (len == 0) return MBUS_DECODE_TOO_SHORT;
+  MBusDecodeResult err = MBUS_DECODE_BAD_START;
+  const uint8_t* p = 0;
+  for (size_t start = 0; start < len && !p; start++) {
+    if (buf[start] != MBUS_FRAME_LONG_START) continue;
+    MBusDecodeResult r = mbusCheckLongFrame(buf + start, len - start);
+    if (r == MBUS_DECODE_OK) p = buf + start;
+    else if (err == MBUS_DECODE_BAD_START) err = r;
+  }
+  if (!p) return err;
+  uint8_t l = p[1];
+
+  frame.c = p[4];
+  frame.a = p[5];
+  frame.ci = p[6];
+  frame.frameLen = (size_t)l + 6;
+  frame.id = 0;
+  frame.manufacturer = 0;
+  frame.version = 0;
+  frame.medium = 0;
+
+  const uint8_t* user = p + 7;   // hinter dem CI-Feld
+  size_t userLen = l - 3;
+  size_t headerLen;
+  if (frame.ci == MBUS_CI_RSP_UD_LONG) {
+    headerLen = 12;
+    if (userLen < headerLen) return MBUS_DECODE_BAD_LENGTH;
+    uint64_t id;
+    if (!mbusBcdToUInt(user, 4, id)) id = 0;
+    frame.id = (uint32_t)id;
+    frame.manufacturer = user[4] | (user[5] << 8);
+    frame.version = user[6];
+    frame.medium = user[7];
+    frame.accessNo = user[8];
+    frame.status = user[9];
+    frame.signature = user[10] | (user[11] << 8);
+  } else if (frame.ci == MBUS_CI_RSP_UD_SHORT) {
+    headerLen = 4;
+    if (userLen < headerLen) return MBUS_DECODE_BAD_LENGTH;
+    frame.accessNo = user[0];
+    frame.status = user[1];
+    frame.signature = user[2] | (user[3] << 8);
+  } else {
+    return MBUS_DECODE_UNSUPPORTED_CI;
+  }
+
+  frame.records = user + headerLen;
+  frame.recordsLen = userLen - headerLen;
+  return MBUS_DECODE_OK;
+}
+
+// ---- Datenrecord ----
+// Alle Zeiger zeigen in den Telegrammpuffer und sind nur gültig solange dieser lebt.
+struct MBusRecord {
+  uint8_t dif;
+  const uint8_t* dife;
+  uint8_t difeLen;
+  uint8_t vif;              // erstes VIF-Byte inkl. Extension-Bit
+  const uint8_t* vife;
+  uint8_t vifeLen;
+  const uint8_t* vifText;   // nur bei Klartext-VIF (0x7C/0xFC), ASCII rückwärts
+  uint8_t vifTextLen;
+  uint8_t coding;           // Datenfeld (DIF Bits 0-3), bei LVAR das LVAR-Byte
+  uint32_t storage;         // Speichernummer aus DIF + DIFEs
+  uint8_t tariff;
+  uint8_t subunit;
+  uint8_t function;         // 0=Momentan, 1=Max, 2=Min, 3=Fehlerwert
+  const uint8_t* data;
+  uint8_t dataLen;
+
+  uint8_t vifCode() const { return vif & 0x7F; }
+  bool isManufacturerData() const { return (dif & 0x0F) == 0x0F; }
+};
+
+class MBusRecordIterator {
+ public:
+  explicit MBusRecordIterator(const MBusFrame& frame)
+    : p_(frame.records), end_(frame.records + frame.recordsLen), error_(false), more_(false) {}
+
+  // Liefert den nächsten Record; false am Ende oder bei defekter Kette (siehe error()).
+  bool next(MBusRecord& rec) {
+    while (p_ < end_) {
+      uint8_t dif = *p_;
+      // 0x2F: Füllbyte
+      if (dif == 0x2F) { p_++; continue; }
+      if ((dif & 0x0F) == 0x0F) {
+        // 0x0F/0x1F: herstellerspezifische Daten bis Telegrammende
+        if (dif != 0x0F && dif != 0x1F) return fail();
+        more_ = (dif == 0x1F);
+        rec = MBusRecord();
+        rec.dif = dif;
+        rec.coding = 0x0F;
+        rec.data = p_ + 1;
+        size_t rest = end_ - p_ - 1;
+        rec.dataLen = rest > 0xFF ? 0xFF : (uint8_t)rest;
+        p_ = end_;
+        return true;
+      }
+      return parseRecord(rec);
+    }
+    return false;
+  }
+
+  bool error() const { return error_; }
+  // DIF 0x1F gesehen: Zähler hat weitere Telegramme
+  bool moreRecordsFollow() const { return more_; }
+
+ private:
+  const uint8_t* p_;
+  const uint8_t* end_;
+  bool error_;
+  bool more_;
+
+  bool fail() {
+    error_ = true;
+    p_ = end_;
+    return false;
+  }
+
+  bool parseRecord(MBusRecord& rec) {
+    const uint8_t* q = p_;
+    rec.dif = *q++;
+    rec.storage = (rec.dif >> 6) & 0x01;
+    rec.function = (rec.dif >> 4) & 0x03;
+    rec.tariff = 0;
+    rec.subunit = 0;
+
+    // DIFE Kette
+    rec.dife = q;
+    rec.difeLen = 0;
+    uint8_t ext = rec.dif & 0x80;
+    while (ext) {
+      if (q >= end_ || rec.difeLen >= MBUS_MAX_DIFE) return fail();
+      uint8_t dife = *q++;
+      if (rec.difeLen < 7) rec.storage |= (uint32_t)(dife & 0x0F) << (1 + 4 * rec.difeLen);
+      rec.tariff |= ((dife >> 4) & 0x03) << (2 * rec.difeLen);
+      rec.subunit |= ((dife >> 6) & 0x01) << rec.difeLen;
+      rec.difeLen++;
+      ext = dife & 0x80;
+    }
+
+    // VIF + VIFE Kette
+    if (q >= end_) return fail();
+    rec.vif = *q++;
+    rec.vife = q;
+    rec.vifeLen = 0;
+    ext = rec.vif & 0x80;
+    while (ext) {
+      if (q >= end_ || rec.vifeLen >= MBUS_MAX_VIFE) return fail();
+      ext = *q++ & 0x80;
+      rec.vifeLen++;
+    }
+
+    // Klartext-VIF: Längenbyte + ASCII
+    rec.vifText = 0;
+    rec.vifTextLen = 0;
+    if (rec.vifCode() == 0x7C) {
+      if (q >= end_) return fail();
+      rec.vifTextLen = *q++;
+      rec.vifText = q;
+      if ((size_t)(end_ - q) < rec.vifTextLen) return fail();
+      q += rec.vifTextLen;
+    }
+
+    // Datenfeld
+    rec.coding = rec.dif & 0x0F;
+    uint8_t dataLen = mbusDifInfo(rec.coding).length;
+    if (dataLen == 0xFF) {
+      // LVAR (0x0D)
+      if (q >= end_) return fail();
+      uint8_t lvar = *q++;
+      rec.coding = lvar;
+      if (lvar <= 0xBF) dataLen = lvar;                    // ASCII
+      else if (lvar <= 0xCF) dataLen = lvar - 0xC0;        // positive BCD
+      else if (lvar <= 0xDF) dataLen = lvar - 0xD0;        // negative BCD
+      else if (lvar <= 0xEF) dataLen = lvar - 0xE0;        // Binärzahl
+      else if (lvar <= 0xF4) dataLen = 4 * (lvar - 0xEF);  // Gleitkomma
+      else return fail();
+    }
+    if ((size_t)(end_ - q) < dataLen) return fail();
+    rec.data = q;
+    rec.dataLen = dataLen;
+    p_ = q + dataLen;
+    return true;
+  }
+};
+
+// Zahlenwert eines Records ohne Skalierung; Datentyp über die DIF-Tabelle.
+// REAL wird nur bei Gleitkomma-T angenommen.
+template <typename T>
+inline bool mbusRecordNumber(const MBusRecord& rec, T& out) {
+  switch (mbusDifInfo(rec.dif).type) {
+    case MBUS_DATA_INT:
+      out = mbusDecodeInt<T>(rec.data, rec.dataLen);
+      return true;
+    case MBUS_DATA_BCD:
+      return mbusDecodeBcd<T>(rec.data, rec.dataLen, out);
+    case MBUS_DATA_REAL:
+      if ((T)0.5 == 0) return false;
+      out = (T)mbusDecodeReal(rec.data);
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Ganzzahl aus Integer- oder BCD-Datenfeld (DIF-Kodierung 1-4, 6, 7, 9-C, E)
+inline bool mbusRecordInt(const MBusRecord& rec, int64_t& out) {
+  return mbusRecordNumber<int64_t>(rec, out);
+}
+
+// Wert in der Einheit der VIF-Tabelle (z.B. m³), Exponent bereits angewendet
+inline bool mbusRecordScaled(const MBusRecord& rec, double& out) {
+  double raw;
+  if (!mbusRecordNumber<double>(rec, raw)) return false;
+  out = raw * mbusScale(mbusVifInfo(rec.vif).exponent);
+  return true;
+}
+
+// ---- Zeitpunkte (Typ F = Datum+Uhrzeit, Typ G = Datum) ----
+struct MBusDateTime {
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  bool invalid;    // IV-Bit des Zählers gesetzt
+};
+
+inline bool mbusDecodeDateTime(const MBusRecord& rec, MBusDateTime& out) {
+  const uint8_t* d = rec.data;
+  uint8_t unit = mbusVifInfo(rec.vif).unit;
+  if (unit == MBUS_UNIT_DATETIME && rec.dataLen == 4) {
+    out.minute = d[0] & 0x3F;
+    out.invalid = (d[0] & 0x80) != 0;
+    out.hour = d[1] & 0x1F;
+    out.day = d[2] & 0x1F;
+    out.month = d[3] & 0x0F;
+    out.year = 2000 + (((d[2] & 0xE0) >> 5) | ((d[3] & 0xF0) >> 1));
+  } else if (unit == MBUS_UNIT_DATE && rec.dataLen == 2) {
+    out.minute = 0;
+    out.hour = 0;
+    out.invalid = false;
+    out.day = d[0] & 0x1F;
+    out.month = d[1] & 0x0F;
+    out.year = 2000 + (((d[0] & 0xE0) >> 5) | ((d[1] & 0xF0) >> 1));
+  } else {
+    return false;
+  }
+  return out.month >= 1 && out.month <= 12 && out.day >= 1;
+}
+
+// ---- Gaszähler-Auswertung ----
+struct MBusGasReading {
+  float volume;             // m³
+  bool hasTimestamp;
+  MBusDateTime timestamp;   // Zählerzeit
+  uint8_t status;           // Statusbyte aus dem Header
+  uint32_t serial;          // Identnummer aus dem Header
+  uint16_t manufacturer;
+  uint8_t medium;
+  uint8_t accessNo;
+  uint8_t address;          // Primäradresse des Antwortenden
+  uint16_t records;         // Anzahl dekodierter Records (alle Telegramme)
+  uint8_t pages;            // Anzahl ausgewerteter Telegramme
+  bool hasVolume;
+};
+
+// Momentanwert Volumen: Einheit m³ laut VIF-Tabelle, Speichernummer 0
+inline bool mbusIsCurrentVolume(const MBusRecord& rec) {
+  return mbusVifInfo(rec.vif).unit == MBUS_UNIT_M3 && rec.storage == 0 && rec.function == 0 && rec.subunit == 0 && rec.tariff == 0;
+}
+
+// Mehrteilige Auslese: vor dem ersten Telegramm zurücksetzen
+inline void mbusBeginGasReading(MBusGasReading& out) {
+  out = MBusGasReading();
+}
+
+// Ein Telegramm (Seite) auswerten und in out übernehmen; bei mehreren Seiten
+// gewinnt jeweils die erste Fundstelle. Der Puffer kann danach für die nächste
+// Seite wiederverwendet werden. more: Zähler meldet weitere Telegramme (DIF 0x1F).
+inline MBusDecodeResult mbusDecodeGasPage(const uint8_t* buf, size_t len, MBusGasReading& out, bool& more) {
+  more = false;
+  MBusFrame frame;
+  MBusDecodeResult r = mbusParseLongFrame(buf, len, frame);
+  if (r != MBUS_DECODE_OK) return r;
+
+  out.status = frame.status;
+  out.accessNo = frame.accessNo;
+  out.address = frame.a;
+  if (frame.ci == MBUS_CI_RSP_UD_LONG) {
+    out.serial = frame.id;
+    out.manufacturer = frame.manufacturer;
+    out.medium = frame.medium;
+  }
+
+  MBusRecordIterator it(frame);
+  MBusRecord rec;
+  while (it.next(rec)) {
+    out.records++;
+    if (!out.hasVolume && mbusIsCurrentVolume(rec)) {
+      double m3;
+      if (mbusRecordScaled(rec, m3)) {
+        out.volume = (float)m3;
+        out.hasVolume = true;
+      }
+    } else if (!out.hasTimestamp && rec.storage == 0 && mbusDecodeDateTime(rec, out.timestamp)) {
+      out.hasTimestamp = true;
+    }
+  }
+  if (it.error()) return MBUS_DECODE_BAD_RECORD;
+  out.pages++;
+  more = it.moreRecordsFollow();
+  return MBUS_DECODE_OK;
+}
+
+inline MBusDecodeResult mbusDecodeGasReading(const uint8_t* buf, size_t len, MBusGasReading& out) {
+  bool more;
+  mbusBeginGasReading(out);
+  MBusDecodeResult r = mbusDecodeGasPage(buf, len, out, more);
+  if (r != MBUS_DECODE_OK) return r;
+  return out.hasVolume ? MBUS_DECODE_OK : MBUS_DECODE_NO_VOLUME;
+}
+
+// ---- Master-Telegramme ----
+const uint8_t MBUS_C_SND_NKE = 0x40;
+const uint8_t MBUS_C_SND_UD = 0x53;
+const uint8_t MBUS_C_REQ_UD2 = 0x5B;
+const uint8_t MBUS_C_FCB = 0x20;             // Frame Count Bit
+const uint8_t MBUS_CI_SELECT = 0x52;         // Sekundäradresse selektieren
+const uint8_t MBUS_CI_BAUD_300 = 0xB8;       // Baudrate umschalten: 0xB8..0xBF = 300..38400 Baud
+const uint8_t MBUS_ADDR_MAX_PRIMARY = 250;
+const uint8_t MBUS_ADDR_NETWORK = 0xFD;      // per Sekundäradresse selektierter Zähler
+const uint8_t MBUS_ADDR_BROADCAST = 0xFF;
+const size_t MBUS_SHORT_FRAME_LEN = 5;
+const size_t MBUS_SELECT_FRAME_LEN = 17;
+const size_t MBUS_CONTROL_FRAME_LEN = 9;
+
+inline size_t mbusBuildShortFrame(uint8_t c, uint8_t a, uint8_t* out) {
+  out[0] = MBUS_FRAME_SHORT_START;
+  out[1] = c;
+  out[2] = a;
+  out[3] = (uint8_t)(c + a);
+  out[4] = MBUS_FRAME_STOP;
+  return MBUS_SHORT_FRAME_LEN;
+}
+
+// Selektion per Sekundäradresse. idPattern sind die 8 Ziffern der Identnummer als
+// Nibbles (0x12345678), 0xF in einem Nibble ist Wildcard. Hersteller, Version und
+// Medium werden nicht eingeschränkt.
+inline size_t mbusBuildSelectFrame(uint32_t idPattern, uint8_t* out) {
+  out[0] = MBUS_FRAME_LONG_START;
+  out[1] = 11;
+  out[2] = 11;
+  out[3] = MBUS_FRAME_LONG_START;
+  out[4] = MBUS_C_SND_UD;
+  out[5] = MBUS_ADDR_NETWORK;
+  out[6] = MBUS_CI_SELECT;
+  for (int i = 0; i < 4; i++) out[7 + i] = (idPattern >> (8 * i)) & 0xFF;
+  out[11] = 0xFF;   // Hersteller
+  out[12] = 0xFF;
+  out[13] = 0xFF;   // Version
+  out[14] = 0xFF;   // Medium
+  uint8_t sum = 0;
+  for (int i = 4; i < 15; i++) sum += out[i];
+  out[15] = sum;
+  out[16] = MBUS_FRAME_STOP;
+  return MBUS_SELECT_FRAME_LEN;
+}
+
+// Kontrolltelegramm (langes Telegramm ohne Nutzdaten), z.B. Baudratenwechsel
+inline size_t mbusBuildControlFrame(uint8_t c, uint8_t a, uint8_t ci, uint8_t* out) {
+  out[0] = MBUS_FRAME_LONG_START;
+  out[1] = 3;
+  out[2] = 3;
+  out[3] = MBUS_FRAME_LONG_START;
+  out[4] = c;
+  out[5] = a;
+  out[6] = ci;
+  out[7] = (uint8_t)(c + a + ci);
+  out[8] = MBUS_FRAME_STOP;
+  return MBUS_CONTROL_FRAME_LEN;
+}
+
+// CI-Feld für den Baudratenwechsel, 0 wenn die Rate nicht in EN 13757-2 vorgesehen ist
+inline uint8_t mbusBaudCI(long baud) {
+  long rate = 300;
+  for (uint8_t ci = MBUS_CI_BAUD_300; ci <= 0xBF; ci++, rate *= 2) {
+    if (rate == baud) return ci;
+  }
+  return 0;
+}
+
+// Dauer eines Telegramms auf der Leitung in ms (8E1 = 11 Bit pro Zeichen)
+inline unsigned long mbusWireTimeMs(size_t bytes, long baud) {
+  return baud > 0 ? (unsigned long)((bytes * 11UL * 1000UL + baud - 1) / baud) : 0;
+}
@@ -0,0 +1,137 @@
+// ---- M-Bus Frame-Ende Erkennung ----
+// Wird Byte für Byte aus dem UART gefüttert und meldet das Telegrammende, sobald
+// das Stopzeichen an der vom L-Feld vorgegebenen Position liegt (bzw. sofort beim
+// Einzelzeichen 0xE5). Eine Pause zwischen zwei Bytes länger als der Gap-Timer
+// beendet ein angefangenes, defektes Telegramm vorzeitig. Bytes vor dem
+// Startzeichen (Echo, Störungen) starten den Gap-Timer nicht.
+// Das Echo des eigenen Telegramms wird anhand der gesendeten Bytes übersprungen,
+// und ein Langrahmen gilt erst mit vollständigem Kopf 68 L L 68 als begonnen:
+// 0x68 oder 0xE5 als Adresse bzw. Prüfsumme im Echo löst keinen Fehlstart aus.
+// Keine Arduino-Abhängigkeiten: auf dem Host mit simuliertem Bytestrom testbar.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum MBusRxStatus {
+  MBUS_RX_PENDING = 0,   // Telegramm noch unvollständig
+  MBUS_RX_COMPLETE,      // Stopzeichen an erwarteter Position
+  MBUS_RX_OVERFLOW,      // Puffer voll vor Telegrammende
+  MBUS_RX_GAP            // Pause zwischen Bytes überschritten
+};
+
+class MBusFrameReceiver {
+ public:
+  MBusFrameReceiver() : buf_(0), cap_(0), expectAck_(false), tx_(0), txLen_(0) { reset(); }
+
+  // expectAck: 0xE5 als vollständige Antwort akzeptieren (SND_NKE, SND_UD).
+  // tx/txLen: das gesendete Telegramm; ein gleichlautender Anfang des Empfangs
+  // ist das Echo am Pegelwandler und wird gespeichert, aber nicht ausgewertet.
+  // tx muss bis zum Ende des Empfangs gültig bleiben.
+  void begin(uint8_t* buf, size_t cap, bool expectAck, const uint8_t* tx = 0, size_t txLen = 0) {
+    buf_ = buf;
+    cap_ = cap;
+    expectAck_ = expectAck;
+    tx_ = tx;
+    txLen_ = tx ? txLen : 0;
+    reset();
+  }
+
+  MBusRxStatus feed(uint8_t b, unsigned long nowMs) {
+    if (status_ != MBUS_RX_PENDING) return status_;
+    if (len_ >= cap_) return status_ = MBUS_RX_OVERFLOW;
+    if (len_ == 0) firstByteMs_ = nowMs;
+    lastByteMs_ = nowMs;
+    byteMs_[len_ % BYTE_TIMES] = nowMs;
+    buf_[len_++] = b;
+
+    if (echo_ < txLen_) {
+      // Echo läuft noch: solange die Bytes dem Gesendeten entsprechen, abwarten
+      if (b == tx_[echo_]) {
+        if (++echo_ == txLen_) scan_ = len_;
+        return status_;
+      }
+      // Kein (vollständiges) Echo: alles Empfangene nach dem Startzeichen absuchen
+      echo_ = txLen_;
+      scan_ = 0;
+    }
+
+    if (frameStart_ < 0 && !findStart()) return status_;
+
+    size_t got = len_ - frameStart_;
+    if (expected_ > 0 && got >= expected_) {
+      if (buf_[len_ - 1] == 0x16 || expected_ == 1) return status_ = MBUS_RX_COMPLETE;
+      // Stopzeichen fehlt: Telegramm ist defekt, nicht auf den Timeout warten
+      return status_ = MBUS_RX_GAP;
+    }
+    return status_;
+  }
+
+  // Gap-Timer: nur aktiv, wenn ein Telegramm begonnen hat
+  MBusRxStatus checkGap(unsigned long nowMs, unsigned long gapMs) {
+    if (status_ == MBUS_RX_PENDING && frameStart_ >= 0 && nowMs - lastByteMs_ > gapMs) status_ = MBUS_RX_GAP;
+    return status_;
+  }
+
+  MBusRxStatus status() const { return status_; }
+  size_t length() const { return len_; }
+  bool started() const { return len_ > 0; }
+  bool frameStarted() const { return frameStart_ >= 0; }
+  unsigned long firstByteMs() const { return firstByteMs_; }
+  unsigned long frameStartMs() const { return frameStartMs_; }  // Startzeichen der Antwort
+  unsigned long lastByteMs() const { return lastByteMs_; }
+
+ private:
+  uint8_t* buf_;
+  size_t cap_;
+  bool expectAck_;
+  size_t len_;
+  long frameStart_;
+  size_t expected_;
+  MBusRxStatus status_;
+  unsigned long firstByteMs_;
+  unsigned long frameStartMs_;
+  unsigned long lastByteMs_;
+  const uint8_t* tx_;
+  size_t txLen_;
+  size_t echo_;       // bisher passende Echo-Bytes
+  size_t scan_;       // nächster Kandidat für das Startzeichen
+
+  // Empfangszeiten der letzten Bytes, für die Latenz ab dem Startzeichen
+  static const size_t BYTE_TIMES = 8;
+  unsigned long byteMs_[BYTE_TIMES];
+
+  // Startzeichen ab scan_ suchen: 0xE5 (falls erwartet) oder ein Kopf 68 L L 68.
+  // Ein unvollständiger Kopf am Pufferende wird beim nächsten Byte erneut geprüft.
+  bool findStart() {
+    for (; scan_ < len_; scan_++) {
+      uint8_t c = buf_[scan_];
+      if (c == 0xE5 && expectAck_) {
+        expected_ = 1;
+      } else if (c == 0x68) {
+        if (len_ - scan_ < 4) return false;
+        uint8_t l = buf_[scan_ + 1];
+        if (buf_[scan_ + 2] != l || buf_[scan_ + 3] != 0x68 || l < 3) continue;
+        expected_ = (size_t)l + 6;
+      } else {
+        continue;
+      }
+      frameStart_ = scan_;
+      frameStartMs_ = len_ - scan_ <= BYTE_TIMES ? byteMs_[scan_ % BYTE_TIMES] : firstByteMs_;
+      return true;
+    }
+    return false;
+  }
+
+  void reset() {
+    len_ = 0;
+    frameStart_ = -1;
+    expected_ = 0;
+    echo_ = 0;
+    scan_ = 0;
+    status_ = MBUS_RX_PENDING;
+    firstByteMs_ = 0;
+    frameStartMs_ = 0;
+    lastByteMs_ = 0;
+  }
+};
@@ -0,0 +1,197 @@
+// ---- M-Bus DIF/VIF Tabellen (EN 13757-3) ----
+// Die Tabellen werden zur Compilezeit aus constexpr-Funktionen erzeugt (C++11,
+// Indexliste per Template) und liegen als konstante Daten im Flash (.rodata),
+// nicht im RAM. Ein Record wird damit über genau einen Tabellenzugriff je DIF
+// und VIF eingeordnet; die Umrechnung erledigen die Kernels unten.
+// Keine Arduino-Abhängigkeiten.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ---- Datenfeld (DIF Bits 0-3) ----
+enum MBusDataType {
+  MBUS_DATA_NONE = 0,
+  MBUS_DATA_INT,          // Ganzzahl, Zweierkomplement, LSB zuerst
+  MBUS_DATA_REAL,         // 32 Bit IEEE 754
+  MBUS_DATA_BCD,          // BCD, LSB zuerst, oberstes Nibble 0xF = negativ
+  MBUS_DATA_SELECTION,    // Auswahl für die Auslese (0x8)
+  MBUS_DATA_VARIABLE,     // LVAR (0xD)
+  MBUS_DATA_SPECIAL       // 0xF: Herstellerdaten, Füllbyte, weitere Telegramme
+};
+
+struct MBusDifInfo {
+  uint8_t length;         // Datenbytes, 0xFF = variabel bzw. Sonderfunktion
+  uint8_t type;           // MBusDataType
+};
+
+// ---- Einheit (primäres VIF, Bits 0-6) ----
+enum MBusUnit {
+  MBUS_UNIT_NONE = 0,
+  MBUS_UNIT_WH, MBUS_UNIT_J, MBUS_UNIT_M3, MBUS_UNIT_KG,
+  MBUS_UNIT_SECONDS, MBUS_UNIT_MINUTES, MBUS_UNIT_HOURS, MBUS_UNIT_DAYS,
+  MBUS_UNIT_W, MBUS_UNIT_J_PER_H, MBUS_UNIT_M3_PER_H, MBUS_UNIT_M3_PER_MIN, MBUS_UNIT_M3_PER_S,
+  MBUS_UNIT_KG_PER_H, MBUS_UNIT_CELSIUS, MBUS_UNIT_KELVIN, MBUS_UNIT_BAR,
+  MBUS_UNIT_DATE,          // Typ G
+  MBUS_UNIT_DATETIME,      // Typ F
+  MBUS_UNIT_HCA,           // Heizkostenverteiler-Einheiten
+  MBUS_UNIT_FABRICATION_NO,
+  MBUS_UNIT_ENHANCED_ID,
+  MBUS_UNIT_BUS_ADDRESS,
+  MBUS_UNIT_EXTENSION,     // 0x7B/0x7D: Einheit steht im ersten VIFE
+  MBUS_UNIT_PLAIN_TEXT,    // 0x7C
+  MBUS_UNIT_ANY,           // 0x7E
+  MBUS_UNIT_MANUFACTURER,  // 0x7F
+  MBUS_UNIT_RESERVED
+};
+
+struct MBusVifInfo {
+  uint8_t unit;           // MBusUnit
+  int8_t exponent;        // Wert = Rohwert * 10^exponent
+};
+
+// ---- Erzeugung zur Compilezeit ----
+constexpr MBusDifInfo mbusDif(uint8_t length, MBusDataType type) {
+  return MBusDifInfo{length, (uint8_t)type};
+}
+
+constexpr MBusDifInfo mbusDifEntry(unsigned c) {
+  return c == 0x0 ? mbusDif(0, MBUS_DATA_NONE) :
+         c <= 0x4 ? mbusDif(c, MBUS_DATA_INT) :
+         c == 0x5 ? mbusDif(4, MBUS_DATA_REAL) :
+         c == 0x6 ? mbusDif(6, MBUS_DATA_INT) :
+         c == 0x7 ? mbusDif(8, MBUS_DATA_INT) :
+         c == 0x8 ? mbusDif(0, MBUS_DATA_SELECTION) :
+         c <= 0xC ? mbusDif(c - 0x8, MBUS_DATA_BCD) :
+         c == 0xD ? mbusDif(0xFF, MBUS_DATA_VARIABLE) :
+         c == 0xE ? mbusDif(6, MBUS_DATA_BCD) :
+                    mbusDif(0xFF, MBUS_DATA_SPECIAL);
+}
+
+constexpr MBusVifInfo mbusVif(MBusUnit unit, int exponent) {
+  return MBusVifInfo{(uint8_t)unit, (int8_t)exponent};
+}
+
+// Zeitdauer: nn = Sekunden, Minuten, Stunden, Tage
+constexpr MBusVifInfo mbusVifDuration(unsigned nn) {
+  return mbusVif((MBusUnit)(MBUS_UNIT_SECONDS + nn), 0);
+}
+
+constexpr MBusVifInfo mbusVifEntry(unsigned v) {
+  return v <= 0x07 ? mbusVif(MBUS_UNIT_WH, (int)(v & 7) - 3) :
+         v <= 0x0F ? mbusVif(MBUS_UNIT_J, (int)(v & 7)) :
+         v <= 0x17 ? mbusVif(MBUS_UNIT_M3, (int)(v & 7) - 6) :
+         v <= 0x1F ? mbusVif(MBUS_UNIT_KG, (int)(v & 7) - 3) :
+         v <= 0x27 ? mbusVifDuration(v & 3) :                       // Einschalt- / Betriebsdauer
+         v <= 0x2F ? mbusVif(MBUS_UNIT_W, (int)(v & 7) - 3) :
+         v <= 0x37 ? mbusVif(MBUS_UNIT_J_PER_H, (int)(v & 7)) :
+         v <= 0x3F ? mbusVif(MBUS_UNIT_M3_PER_H, (int)(v & 7) - 6) :
+         v <= 0x47 ? mbusVif(MBUS_UNIT_M3_PER_MIN, (int)(v & 7) - 7) :
+         v <= 0x4F ? mbusVif(MBUS_UNIT_M3_PER_S, (int)(v & 7) - 9) :
+         v <= 0x57 ? mbusVif(MBUS_UNIT_KG_PER_H, (int)(v & 7) - 3) :
+         v <= 0x5F ? mbusVif(MBUS_UNIT_CELSIUS, (int)(v & 3) - 3) :  // Vorlauf / Rücklauf
+         v <= 0x63 ? mbusVif(MBUS_UNIT_KELVIN, (int)(v & 3) - 3) :
+         v <= 0x67 ? mbusVif(MBUS_UNIT_CELSIUS, (int)(v & 3) - 3) :  // Außentemperatur
+         v <= 0x6B ? mbusVif(MBUS_UNIT_BAR, (int)(v & 3) - 3) :
+         v == 0x6C ? mbusVif(MBUS_UNIT_DATE, 0) :
+         v == 0x6D ? mbusVif(MBUS_UNIT_DATETIME, 0) :
+         v == 0x6E ? mbusVif(MBUS_UNIT_HCA, 0) :
+         v == 0x6F ? mbusVif(MBUS_UNIT_RESERVED, 0) :
+         v <= 0x77 ? mbusVifDuration(v & 3) :                       // Mittelungs- / Aktualitätsdauer
+         v == 0x78 ? mbusVif(MBUS_UNIT_FABRICATION_NO, 0) :
+         v == 0x79 ? mbusVif(MBUS_UNIT_ENHANCED_ID, 0) :
+         v == 0x7A ? mbusVif(MBUS_UNIT_BUS_ADDRESS, 0) :
+         v == 0x7C ? mbusVif(MBUS_UNIT_PLAIN_TEXT, 0) :
+         v == 0x7E ? mbusVif(MBUS_UNIT_ANY, 0) :
+         v == 0x7F ? mbusVif(MBUS_UNIT_MANUFACTURER, 0) :
+                     mbusVif(MBUS_UNIT_EXTENSION, 0);               // 0x7B, 0x7D
+}
+
+// Zehnerpotenzen für die Exponenten -9..7 der Tabelle
+const int MBUS_EXP_MIN = -9;
+const int MBUS_EXP_MAX = 7;
+
+constexpr double mbusPow10(int e) {
+  return e == 0 ? 1.0 : e > 0 ? 10.0 * mbusPow10(e - 1) : mbusPow10(e + 1) / 10.0;
+}
+
+// Indexliste 0..N-1 (std::index_sequence gibt es erst ab C++14)
+template <unsigned... I> struct MBusIndexList {};
+template <unsigned N, unsigned... I> struct MBusMakeIndexList : MBusMakeIndexList<N - 1, N - 1, I...> {};
+template <unsigned... I> struct MBusMakeIndexList<0, I...> { typedef MBusIndexList<I...> type; };
+
+template <typename List> struct MBusDifTableGen;
+template <unsigned... I> struct MBusDifTableGen<MBusIndexList<I...> > {
+  static constexpr MBusDifInfo table[sizeof...(I)] = {mbusDifEntry(I)...};
+};
+template <unsigned... I> constexpr MBusDifInfo MBusDifTableGen<MBusIndexList<I...> >::table[sizeof...(I)];
+
+template <typename List> struct MBusVifTableGen;
+template <unsigned... I> struct MBusVifTableGen<MBusIndexList<I...> > {
+  static constexpr MBusVifInfo table[sizeof...(I)] = {mbusVifEntry(I)...};
+};
+template <unsigned... I> constexpr MBusVifInfo MBusVifTableGen<MBusIndexList<I...> >::table[sizeof...(I)];
+
+template <typename List> struct MBusPow10TableGen;
+template <unsigned... I> struct MBusPow10TableGen<MBusIndexList<I...> > {
+  static constexpr double table[sizeof...(I)] = {mbusPow10((int)I + MBUS_EXP_MIN)...};
+};
+template <unsigned... I> constexpr double MBusPow10TableGen<MBusIndexList<I...> >::table[sizeof...(I)];
+
+typedef MBusDifTableGen<MBusMakeIndexList<16>::type> MBusDifTable;      // DIF Bits 0-3
+typedef MBusVifTableGen<MBusMakeIndexList<128>::type> MBusVifTable;     // VIF Bits 0-6
+typedef MBusPow10TableGen<MBusMakeIndexList<MBUS_EXP_MAX - MBUS_EXP_MIN + 1>::type> MBusPow10Table;
+
+// Stichproben, damit Tabellenfehler schon beim Übersetzen auffallen
+static_assert(mbusDifEntry(0x4).length == 4 && mbusDifEntry(0xC).type == MBUS_DATA_BCD, "DIF Tabelle");
+static_assert(mbusDifEntry(0xE).length == 6 && mbusDifEntry(0xD).length == 0xFF, "DIF Tabelle");
+static_assert(mbusVifEntry(0x13).unit == MBUS_UNIT_M3 && mbusVifEntry(0x13).exponent == -3, "VIF Tabelle");
+static_assert(mbusVifEntry(0x6D).unit == MBUS_UNIT_DATETIME && mbusVifEntry(0x5B).unit == MBUS_UNIT_CELSIUS, "VIF Tabelle");
+
+inline const MBusDifInfo& mbusDifInfo(uint8_t dif) { return MBusDifTable::table[dif & 0x0F]; }
+inline const MBusVifInfo& mbusVifInfo(uint8_t vif) { return MBusVifTable::table[vif & 0x7F]; }
+
+inline double mbusScale(int8_t exponent) {
+  if (exponent < MBUS_EXP_MIN || exponent > MBUS_EXP_MAX) return 1.0;
+  return MBusPow10Table::table[exponent - MBUS_EXP_MIN];
+}
+
+// ---- Kernels ----
+// Ganzzahl LSB zuerst, Vorzeichen auf die volle Breite von T erweitert
+template <typename T>
+inline T mbusDecodeInt(const uint8_t* p, uint8_t len) {
+  uint64_t v = 0;
+  for (int i = len - 1; i >= 0; i--) v = (v << 8) | p[i];
+  uint8_t bits = len * 8;
+  if (bits > 0 && bits < 64 && ((v >> (bits - 1)) & 1)) v |= ~0ULL << bits;
+  return (T)(int64_t)v;
+}
+
+// BCD LSB zuerst; oberstes Nibble 0xF kennzeichnet negative Werte.
+// false bei ungültigen Ziffern oder mehr als 18 Stellen.
+template <typename T>
+inline bool mbusDecodeBcd(const uint8_t* p, uint8_t len, T& out) {
+  if (len == 0 || len > 9) return false;
+  T value = 0;
+  bool negative = false;
+  for (int i = len - 1; i >= 0; i--) {
+    uint8_t hi = p[i] >> 4;
+    uint8_t lo = p[i] & 0x0F;
+    if (i == len - 1 && hi == 0x0F) {
+      negative = true;
+      hi = 0;
+    }
+    if (hi > 9 || lo > 9) return false;
+    value = value * 100 + hi * 10 + lo;
+  }
+  out = negative ? -value : value;
+  return true;
+}
+
+inline float mbusDecodeReal(const uint8_t* p) {
+  uint32_t bits = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
@@ -0,0 +1,102 @@
+// ---- MQTT Outbox (Store-and-Forward) ----
+// Messwerte, die nicht gesendet werden konnten, warten hier mit Zeitstempel,
+// bis der Broker wieder erreichbar ist. Der RAM-Ring nimmt die neuesten Werte
+// auf; läuft er voll, lagert der Aufrufer die ältesten Einträge blockweise in
+// den Flash aus. Beim Abbau begrenzt ein Token-Bucket die Senderate, damit ein
+// Reconnect nach langer Pause weder den Broker flutet noch loop() blockiert.
+// Keine Arduino-Abhängigkeiten: Zeitstempel kommen vom Aufrufer.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct OutboxEntry {
+  uint32_t time;      // Unixzeit s, 0 = beim Einreihen noch keine NTP-Zeit
+  uint32_t ms;        // millis() beim Einreihen (nur im selben Boot aussagekräftig)
+  float volume;       // m³
+  uint8_t meter;      // Index in der Zählertabelle
+  uint8_t reserved[3];
+};
+
+template <size_t N>
+class OutboxRing {
+ public:
+  OutboxRing() : head_(0), count_(0) {}
+
+  // false, wenn voll (der Aufrufer lagert vorher aus)
+  bool push(const OutboxEntry& e) {
+    if (count_ == N) return false;
+    slots_[(head_ + count_) % N] = e;
+    count_++;
+    return true;
+  }
+
+  // Bis zu max der ältesten Einträge nach out verschieben, liefert die Anzahl
+  size_t take(OutboxEntry* out, size_t max) {
+    size_t n = 0;
+    while (n < max && count_ > 0) {
+      out[n++] = slots_[head_];
+      head_ = (head_ + 1) % N;
+      count_--;
+    }
+    return n;
+  }
+
+  const OutboxEntry& front() const { return slots_[head_]; }
+  // i-ter Eintrag ab dem ältesten, z. B. um Zeitstempel nachzutragen
+  OutboxEntry& at(size_t i) { return slots_[(head_ + i) % N]; }
+  void pop() {
+    if (count_ == 0) return;
+    head_ = (head_ + 1) % N;
+    count_--;
+  }
+
+  size_t size() const { return count_; }
+  size_t capacity() const { return N; }
+  bool full() const { return count_ == N; }
+  bool empty() const { return count_ == 0; }
+
+ private:
+  OutboxEntry slots_[N];
+  size_t head_;
+  size_t count_;
+};
+
+// Token-Bucket: ratePerSec Nachrichten im Mittel, bis zu burst am Stück
+class TokenBucket {
+ public:
+  TokenBucket() : ratePerSec_(1), burst_(1), tokensMilli_(1000), lastMs_(0) {}
+
+  void begin(uint32_t ratePerSec, uint32_t burst, unsigned long nowMs) {
+    ratePerSec_ = ratePerSec;
+    burst_ = burst;
+    tokensMilli_ = burst * 1000UL;
+    lastMs_ = nowMs;
+  }
+
+  bool take(unsigned long nowMs) {
+    refill(nowMs);
+    if (tokensMilli_ < 1000) return false;
+    tokensMilli_ -= 1000;
+    return true;
+  }
+
+  uint32_t tokens(unsigned long nowMs) {
+    refill(nowMs);
+    return tokensMilli_ / 1000;
+  }
+
+ private:
+  uint32_t ratePerSec_;
+  uint32_t burst_;
+  uint32_t tokensMilli_;   // Tausendstel Token, damit auch kurze loop()-Abstände zählen
+  unsigned long lastMs_;
+
+  void refill(unsigned long nowMs) {
+    unsigned long dt = nowMs - lastMs_;
+    lastMs_ = nowMs;
+    uint32_t cap = burst_ * 1000UL;
+    uint64_t t = tokensMilli_ + (uint64_t)dt * ratePerSec_;
+    tokensMilli_ = t > cap ? cap : (uint32_t)t;
+  }
+};
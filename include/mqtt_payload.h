@@ -0,0 +1,92 @@
+// ---- MQTT-Topics und Payloads der Messwerte ----
+// Gemeinsam für die Firmware (mbusPublishReading) und tools/mbus_replay, damit
+// das Host-Tool genau das ausgibt, was gesendet würde: Topic-Schema je Zähler,
+// Einzelwerte bzw. JSON-Status (mqtt_json) und die Totzonen-Entscheidung
+// (pub_change_only).
+// Keine Arduino-Abhängigkeiten.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "publish_filter.h"
+
+// Topics eines Zählers, einmal beim Übernehmen der Zählertabelle gebaut
+struct MqttMeterTopics {
+  char topic[80];   // Volumen in m³
+  char energy[96];  // <topic>_energy: Energie in kWh
+  char rate[96];    // <topic>_mbus_rate: erfolgreiche Polls in %
+  char state[96];   // <topic>_state: JSON-Status (mqtt_json)
+};
+
+// Zähler 0 nutzt das Basis-Topic, weitere hängen die Identnummer
+// (Sekundäradressierung) bzw. die Primäradresse an
+inline void mqttBuildMeterTopics(MqttMeterTopics& t, const char* base, int index, uint8_t address, uint32_t secondaryId) {
+  if (index == 0) {
+    snprintf(t.topic, sizeof(t.topic), "%s", base);
+  } else if (secondaryId) {
+    snprintf(t.topic, sizeof(t.topic), "%s_%08lX", base, (unsigned long)secondaryId);
+  } else {
+    snprintf(t.topic, sizeof(t.topic), "%s_%u", base, address);
+  }
+  snprintf(t.energy, sizeof(t.energy), "%s_energy", t.topic);
+  snprintf(t.rate, sizeof(t.rate), "%s_mbus_rate", t.topic);
+  snprintf(t.state, sizeof(t.state), "%s_state", t.topic);
+}
+
+// Einstellungen, die Inhalt und Zeitpunkt der Publishes bestimmen
+struct MqttPublishConfig {
+  bool json;                  // mqtt_json: ein Statustopic statt Einzelwerten
+  bool changeOnly;            // pub_change_only
+  unsigned long heartbeatMs;  // pub_heartbeat
+  float volumeDb;             // Totzonen
+  float rateDb;
+  int rssiDb;
+  float calorific;            // Brennwert kWh/m³
+  float correction;           // Z-Zahl
+};
+
+// Ein Messwert, wie er veröffentlicht wird
+struct MqttReadingValues {
+  float volume;  // m³
+  float energy;  // kWh
+  float rate;    // % erfolgreiche Polls des Zählers
+  bool hasRssi;  // WLAN-Pegel geht nur mit dem ersten Zähler raus
+  int rssi;      // dBm
+};
+
+inline float mqttEnergyKwh(float volume, const MqttPublishConfig& c) {
+  return volume * c.calorific * c.correction;
+}
+
+// Fällige Werte; mit mqtt_json geht der Status raus, sobald einer fällig ist
+struct MqttPublishDue {
+  bool volume;  // inkl. Energie
+  bool rate;
+  bool rssi;
+  bool any() const { return volume || rate || rssi; }
+};
+
+inline MqttPublishDue mqttPublishDue(const MqttPublishConfig& c, const MqttReadingValues& v, const DeadbandFilter& volume,
+                                     const DeadbandFilter& rate, const DeadbandFilter& rssi, unsigned long nowMs) {
+  MqttPublishDue d;
+  d.volume = !c.changeOnly || volume.due(v.volume, c.volumeDb, nowMs, c.heartbeatMs);
+  d.rate = !c.changeOnly || rate.due(v.rate, c.rateDb, nowMs, c.heartbeatMs);
+  d.rssi = v.hasRssi && (!c.changeOnly || rssi.due(v.rssi, c.rssiDb, nowMs, c.heartbeatMs));
+  return d;
+}
+
+// Payloads; Rückgabe wie snprintf
+inline int mqttFormatVolume(char* buf, size_t size, float volume) { return snprintf(buf, size, "%.2f", volume); }
+inline int mqttFormatEnergy(char* buf, size_t size, float energy) { return snprintf(buf, size, "%.1f", energy); }
+inline int mqttFormatRate(char* buf, size_t size, float rate) { return snprintf(buf, size, "%.1f", rate); }
+inline int mqttFormatRssi(char* buf, size_t size, int rssi) { return snprintf(buf, size, "%d", rssi); }
+
+inline int mqttFormatState(char* buf, size_t size, const MqttReadingValues& v) {
+  if (v.hasRssi) {
+    return snprintf(buf, size, "{\"volume\":%.2f,\"energy\":%.1f,\"wifi\":%d,\"mbus_rate\":%.1f}",
+                    v.volume, v.energy, v.rssi, v.rate);
+  }
+  return snprintf(buf, size, "{\"volume\":%.2f,\"energy\":%.1f,\"mbus_rate\":%.1f}", v.volume, v.energy, v.rate);
+}
@@ -0,0 +1,93 @@
+// ---- Adaptives Poll-Intervall ----
+// Schätzt den aktuellen Durchfluss aus den letzten Zählerständen. Ändert sich der
+// Stand, wird das Intervall so gewählt, dass zwischen zwei Abfragen etwa stepM3
+// durchfließt (hoher Durchfluss = kurzes Intervall, höchstens bis zum Minimum);
+// ohne verwertbare Schätzung gilt das Minimum. Bleibt der Stand gleich,
+// verdoppelt sich das Intervall bis zum Maximum.
+// Keine Arduino-Abhängigkeiten: Zeitstempel in ms kommen vom Aufrufer.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+class AdaptivePollScheduler {
+ public:
+  static const size_t WINDOW = 4;   // Stützstellen für die Durchfluss-Schätzung
+
+  AdaptivePollScheduler() : minMs_(10000), maxMs_(300000), intervalMs_(30000), stepM3_(0.01f), count_(0), flow_(0) {}
+
+  // stepM3: Volumen je Abfrage bei laufendem Durchfluss, Standard = Auflösung
+  // des veröffentlichten Zählerstands (zwei Nachkommastellen)
+  void begin(unsigned long minMs, unsigned long maxMs, unsigned long startMs, float stepM3 = 0.01f) {
+    if (maxMs < minMs) maxMs = minMs;
+    minMs_ = minMs;
+    maxMs_ = maxMs;
+    stepM3_ = stepM3 > 0 ? stepM3 : 0.01f;
+    intervalMs_ = clamp(startMs);
+    count_ = 0;
+    flow_ = 0;
+  }
+
+  // Neuen Zählerstand übernehmen, liefert das nächste Intervall
+  unsigned long update(float volume, unsigned long nowMs) {
+    bool rising = false;
+    if (count_ > 0) {
+      const Sample& last = samples_[(count_ - 1) % WINDOW];
+      if (volume < last.volume) {
+        // Zählertausch oder Überlauf: Fenster verwerfen
+        count_ = 0;
+      } else if (volume > last.volume) {
+        rising = true;
+      } else {
+        intervalMs_ = clamp(intervalMs_ * 2);
+      }
+    }
+    samples_[count_ % WINDOW].volume = volume;
+    samples_[count_ % WINDOW].ms = nowMs;
+    count_++;
+    flow_ = estimateFlow();
+    if (rising) intervalMs_ = flowInterval();
+    return intervalMs_;
+  }
+
+  unsigned long interval() const { return intervalMs_; }
+  float flowM3h() const { return flow_; }   // 0 solange weniger als zwei Werte vorliegen
+
+ private:
+  struct Sample {
+    float volume;
+    unsigned long ms;
+  };
+
+  unsigned long minMs_;
+  unsigned long maxMs_;
+  unsigned long intervalMs_;
+  float stepM3_;
+  size_t count_;
+  float flow_;
+  Sample samples_[WINDOW];
+
+  unsigned long clamp(unsigned long ms) const {
+    if (ms < minMs_) return minMs_;
+    if (ms > maxMs_) return maxMs_;
+    return ms;
+  }
+
+  // Zeit, in der beim geschätzten Durchfluss stepM3 durchfließt
+  unsigned long flowInterval() const {
+    if (flow_ <= 0) return minMs_;
+    float ms = stepM3_ * 3600000.0f / flow_;
+    if (ms >= (float)maxMs_) return maxMs_;
+    return clamp((unsigned long)ms);
+  }
+
+  float estimateFlow() const {
+    if (count_ < 2) return 0;
+    size_t n = count_ < WINDOW ? count_ : WINDOW;
+    const Sample& first = samples_[(count_ - n) % WINDOW];
+    const Sample& last = samples_[(count_ - 1) % WINDOW];
+    unsigned long dt = last.ms - first.ms;
+    if (dt == 0) return 0;
+    return (last.volume - first.volume) * 3600000.0f / dt;
+  }
+};
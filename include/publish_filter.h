@@ -0,0 +1,41 @@
+// ---- Änderungsfilter für MQTT-Publishes ----
+// Ein Wert wird nur gesendet, wenn er sich seit dem letzten Senden um mindestens
+// die Totzone geändert hat (Totzone 0 = jede Änderung) oder das Heartbeat-
+// Intervall abgelaufen ist, damit Abnehmer weiterhin ein Lebenszeichen sehen.
+// Keine Arduino-Abhängigkeiten: Zeitstempel in ms kommen vom Aufrufer.
+#pragma once
+
+#include <stdint.h>
+
+class DeadbandFilter {
+ public:
+  DeadbandFilter() : valid_(false), last_(0), lastMs_(0) {}
+
+  bool due(float value, float deadband, unsigned long nowMs, unsigned long heartbeatMs) const {
+    if (!valid_) return true;
+    if (nowMs - lastMs_ >= heartbeatMs) return true;
+    float delta = value - last_;
+    if (delta < 0) delta = -delta;
+    return deadband > 0 ? delta >= deadband : delta != 0;
+  }
+
+  void published(float value, unsigned long nowMs) {
+    valid_ = true;
+    last_ = value;
+    lastMs_ = nowMs;
+  }
+
+  // Nächster Wert wird in jedem Fall gesendet (z.B. nach einem Reconnect)
+  void reset() { valid_ = false; }
+
+ private:
+  bool valid_;
+  float last_;
+  unsigned long lastMs_;
+};
+
+// Gesendete und unterdrückte Publishes je Wert
+struct PublishCounter {
+  uint32_t published;
+  uint32_t suppressed;
+};
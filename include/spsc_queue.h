@@ -0,0 +1,52 @@
+// ---- Lock-freie Queue (ein Produzent, ein Konsument) ----
+// Feste Größe, keine Heap-Allokation. Genau ein Task darf push() aufrufen und
+// genau ein anderer Task pop(); dann genügen zwei atomare Indizes ohne Mutex.
+// Ist die Queue voll, schlägt push() fehl und der Eintrag wird als verworfen gezählt.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SpscQueue {
+ public:
+  SpscQueue() : head_(0), tail_(0), dropped_(0) {}
+
+  // Nur vom Produzenten aufrufen
+  bool push(const T& item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t next = (head + 1) % (N + 1);
+    if (next == tail_.load(std::memory_order_acquire)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slots_[head] = item;
+    head_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Nur vom Konsumenten aufrufen
+  bool pop(T& item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) return false;
+    item = slots_[tail];
+    tail_.store((tail + 1) % (N + 1), std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return (head + N + 1 - tail) % (N + 1);
+  }
+
+  size_t capacity() const { return N; }
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  T slots_[N + 1];   // ein Slot bleibt frei, um voll und leer zu unterscheiden
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+  std::atomic<uint32_t> dropped_;
+};
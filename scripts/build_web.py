@@ -0,0 +1,87 @@
+# ---- Web-UI Asset-Pipeline ----
+# Minifiziert web/index.html, komprimiert das Ergebnis mit gzip und erzeugt
+# include/web_ui.h mit dem Byte-Array (PROGMEM) und einem ETag aus dem
+# Inhalts-Hash. handleRoot() liefert das Array unverändert mit
+# Content-Encoding: gzip aus.
+#
+# Läuft als PlatformIO pre-Script (extra_scripts in platformio.ini) vor jedem
+# Build, lässt sich aber auch direkt aufrufen:  python scripts/build_web.py
+# Die erzeugte Datei wird nur neu geschrieben, wenn sich der Inhalt ändert,
+# damit main.cpp nicht bei jedem Build neu übersetzt wird.
+import gzip
+import hashlib
+import io
+import os
+import re
+import sys
+
+try:
+    Import("env")  # noqa: F821 (von PlatformIO/SCons bereitgestellt)
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SOURCE = os.path.join(PROJECT_DIR, "web", "index.html")
+TARGET = os.path.join(PROJECT_DIR, "include", "web_ui.h")
+
+
+def minify(html):
+    # Bewusst konservativ: nur Kommentare und Einrückung entfernen. Zeilenumbrüche
+    # bleiben stehen, damit JavaScript ohne Semikolon (ASI) gültig bleibt.
+    html = re.sub(r"<!--.*?-->", "", html, flags=re.S)
+    out = []
+    in_template = False  # innerhalb eines mehrzeiligen `Template-Strings`
+    for line in html.splitlines():
+        stripped = line.strip()
+        if not stripped:
+            continue
+        if not in_template and stripped.startswith("//"):
+            continue
+        out.append(stripped)
+        if len(re.findall(r"(?<!\\)`", stripped)) % 2 == 1:
+            in_template = not in_template
+    return "\n".join(out) + "\n"
+
+
+def render_header(data, etag, raw_len):
+    lines = [
+        "// Automatisch erzeugt von scripts/build_web.py aus web/index.html - nicht bearbeiten",
+        "#pragma once",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "// Original %d Bytes, gzip %d Bytes" % (raw_len, len(data)),
+        'const char WEB_UI_ETAG[] = "\\"%s\\"";' % etag,
+        "const size_t WEB_UI_GZ_LEN = %d;" % len(data),
+        "const uint8_t WEB_UI_GZ[] PROGMEM = {",
+    ]
+    for i in range(0, len(data), 20):
+        lines.append("  " + ", ".join("0x%02X" % b for b in data[i:i + 20]) + ",")
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def build():
+    with open(SOURCE, "rb") as f:
+        html = f.read().decode("utf-8")
+    minified = minify(html).encode("utf-8")
+
+    # mtime=0, damit gleiche Eingabe byte-gleiche Ausgabe (und gleichen ETag) ergibt
+    buf = io.BytesIO()
+    with gzip.GzipFile(fileobj=buf, mode="wb", compresslevel=9, mtime=0) as gz:
+        gz.write(minified)
+    data = buf.getvalue()
+    etag = hashlib.sha256(data).hexdigest()[:16]
+
+    header = render_header(data, etag, len(html.encode("utf-8")))
+    if os.path.exists(TARGET):
+        with open(TARGET, "r") as f:
+            if f.read() == header:
+                return
+    with open(TARGET, "w") as f:
+        f.write(header)
+    print("web_ui.h: %d -> %d Bytes minifiziert -> %d Bytes gzip, ETag %s" %
+          (len(html.encode("utf-8")), len(minified), len(data), etag))
+
+
+build()
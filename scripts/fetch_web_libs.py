@@ -0,0 +1,57 @@
+# ---- JavaScript-Bibliotheken für das LittleFS-Image ----
+# Lädt die von der Web-UI benötigten Bibliotheken in festen Versionen und legt
+# sie gzip-komprimiert unter data/lib/ ab. Von dort landen sie im LittleFS-Image
+# (pio run -t uploadfs) und werden vom ESP32 als /lib/... ausgeliefert, sodass
+# die Oberfläche ohne Internetzugang funktioniert (AP-Modus, isolierte Netze).
+#
+# Läuft als PlatformIO pre-Script bei buildfs/uploadfs, lässt sich aber auch
+# direkt aufrufen:  python scripts/fetch_web_libs.py
+# Vorhandene Dateien werden nicht erneut geladen; die Version steht im
+# Dateinamen, damit der Browser sie unbegrenzt cachen darf.
+import gzip
+import os
+import sys
+import urllib.request
+
+try:
+    Import("env")  # noqa: F821 (von PlatformIO/SCons bereitgestellt)
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+    TARGETS = COMMAND_LINE_TARGETS  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    TARGETS = None
+
+# Name im LittleFS (ohne .gz) -> Quelle; muss zu den <script>-Tags in web/index.html passen
+LIBS = [
+    ("chart-4.4.0.min.js",
+     "https://cdn.jsdelivr.net/npm/chart.js@4.4.0/dist/chart.umd.min.js"),
+    ("chart-adapter-3.0.0.min.js",
+     "https://cdn.jsdelivr.net/npm/chartjs-adapter-date-fns@3.0.0/dist/chartjs-adapter-date-fns.bundle.min.js"),
+]
+
+LIB_DIR = os.path.join(PROJECT_DIR, "data", "lib")
+
+
+def fetch():
+    if not os.path.isdir(LIB_DIR):
+        os.makedirs(LIB_DIR)
+    for name, url in LIBS:
+        target = os.path.join(LIB_DIR, name + ".gz")
+        if os.path.exists(target):
+            continue
+        print("Lade %s ..." % url)
+        with urllib.request.urlopen(url, timeout=30) as resp:
+            data = resp.read()
+        # mtime=0: gleicher Inhalt ergibt ein byte-gleiches Image
+        with gzip.GzipFile(target, mode="wb", compresslevel=9, mtime=0) as gz:
+            gz.write(data)
+        print("  %s: %d -> %d Bytes" % (name, len(data), os.path.getsize(target)))
+
+
+if TARGETS is None or any(t in TARGETS for t in ("buildfs", "uploadfs", "uploadfsota")):
+    try:
+        fetch()
+    except Exception as e:
+        # Ohne Bibliotheken wäre das Image unvollständig: Build abbrechen
+        sys.stderr.write("fetch_web_libs: %s\n" % e)
+        sys.exit(1)
@@ -7,8 +7,23 @@
 #include <ESPmDNS.h>
 #include <Update.h>
 #include <ESP32Ping.h>
+#include <LittleFS.h>
 #include <time.h>
+#include <sys/time.h>
+#include <lwip/sockets.h>
 #include <vector>
+#include "mbus_decoder.h"
+#include "mbus_receiver.h"
+#include "spsc_queue.h"
+#include "poll_scheduler.h"
+#include "latency_histogram.h"
+#include "mbus_capture.h"
+#include "mqtt_outbox.h"
+#include "publish_filter.h"
+#include "mqtt_payload.h"
+#include "json_writer.h"
+#include "lttb.h"
+#include "web_ui.h"
 
 // ---- ANSI Farb-Codes für Serial Monitor (deaktiviert für reine Text-Ausgabe) ----
 #define ANSI_RESET   ""
@@ -31,8 +46,24 @@ char mqtt_user[64] = ""; // MQTT Username (optional)
 char mqtt_pass[64] = ""; // MQTT Password (optional)
 char mqtt_topic[64] = "gaszaehler/verbrauch";
 char mqtt_availability_topic[64] = "gaszaehler/availability";
+char mqtt_read_topic[80] = "gaszaehler/verbrauch_read";                // Kommando: frisch auslesen
+char mqtt_read_result_topic[80] = "gaszaehler/verbrauch_read_result";  // Antwort darauf
 char mqtt_client_id[32] = "ESP32GasClient";
+bool mqtt_json = false;              // ein JSON-Statustopic je Messung statt einzelner Werte-Topics
+bool ha_device_discovery = false;    // HA Discovery als ein Geräte-Payload (ab HA 2024.11)
+bool pub_change_only = false;        // nur bei Änderung senden (Totzonen), spätestens nach pub_heartbeat
+unsigned long pub_heartbeat = 300000; // ms, max. Abstand zwischen zwei Publishes eines Werts
+float pub_volume_db = 0;             // m³, 0 = jede Änderung
+int pub_rssi_db = 3;                 // dBm
+float pub_rate_db = 1.0;             // Prozentpunkte M-Bus Rate
+char mqtt_wifi_topic[80] = "gaszaehler/verbrauch_wifi";
+char mqtt_backlog_topic[80] = "gaszaehler/verbrauch_backlog";  // nachgereichte Messwerte aus der Outbox
 unsigned long poll_interval = 30000; // Standard: 30 Sekunden
+bool poll_adaptive = false;          // Intervall nach Durchfluss anpassen
+unsigned long poll_min = 10000;      // adaptiv: kürzestes Intervall (Gas fließt)
+unsigned long poll_max = 600000;     // adaptiv: längstes Intervall (kein Verbrauch)
+long mbus_baud = 2400;               // Ziel-Baudrate, Zähler werden beim ersten Poll umgeschaltet
+bool poll_align = false;             // nach NTP-Sync auf volle Intervallgrenzen der Uhr (:00/:30) abfragen
 float gas_calorific_value = 10.0; // kWh/m - Brennwert (typisch 8-12 kWh/m)
 float gas_correction_factor = 1.0; // Z-Zahl Korrekturfaktor (typisch 0.95-1.0)
 bool use_static_ip = false;
@@ -49,7 +80,6 @@ const unsigned long INACTIVITY_TIMEOUT = 600000; // 10 Minuten keine Aktivitt
 
 Preferences preferences;
 Preferences historyPrefs;
-bool haDiscoverySent = false;
 
 // ---- WiFi AP Mode ----
 bool apMode = false;
@@ -105,6 +135,7 @@ bool isDST(time_t now) {
 struct ErrorStats {
   unsigned long mbusTimeouts = 0;
   unsigned long mbusParseErrors = 0;
+  unsigned long mbusRetries = 0;
   unsigned long mqttErrors = 0;
   unsigned long wifiDisconnects = 0;
   unsigned long lastError = 0;
@@ -117,12 +148,27 @@ struct MBusStats {
   unsigned long totalPolls = 0;
   unsigned long successfulPolls = 0;
   unsigned long totalResponseTime = 0;
-  unsigned long lastResponseTime = 0;
+  unsigned long lastResponseTime = 0;  // Poll gesendet -> letztes Byte
+  unsigned long lastFirstByteTime = 0; // Poll gesendet -> erstes Byte
   unsigned long avgResponseTime = 0;
-  String lastHexDump = "";
+  unsigned long lastWireTime = 0;      // Leitungszeit der letzten Antwort bei der verwendeten Baudrate
+  long lastBaud = 0;
 };
 MBusStats mbusStats;
 
+// Latenz je Stufe: Poll gesendet -> erstes Byte -> letztes Byte -> dekodiert -> MQTT.
+// Die ersten drei Stufen schreibt der M-Bus Task, die letzten beiden loop();
+// ein Reset wird deshalb für den Task nur angefordert.
+struct MBusLatencyStats {
+  LatencyHistogram firstByte;   // Telegramm gesendet -> Startzeichen (Zähler)
+  LatencyHistogram transfer;    // Startzeichen -> Stopzeichen (UART/Leitung)
+  LatencyHistogram decodeUs;    // Dekodieren einer Seite, in µs
+  LatencyHistogram publish;     // dekodiert -> MQTT gesendet (Queue + Broker)
+  LatencyHistogram total;       // Beginn der Auslese -> MQTT gesendet
+};
+MBusLatencyStats mbusLatency;
+volatile bool mbusLatencyResetRequested = false;
+
 String lastErrorMessage = "";
 
 // ---- Live Log System ----
@@ -132,6 +178,8 @@ struct LogEntry {
   String message;
 };
 std::vector<LogEntry> logBuffer;
+SemaphoreHandle_t logMutex = xSemaphoreCreateMutex(); // addLog() wird auch aus dem M-Bus Task gerufen
+uint32_t logSeq = 0; // Anzahl bisher geloggter Einträge, für Push an die WebUI
 
 void addLog(const String& msg) {
   // ANSI-Codes aus der Nachricht entfernen für WebUI (nur im logBuffer)
@@ -149,12 +197,15 @@ void addLog(const String& msg) {
   LogEntry entry;
   entry.timestamp = millis();
   entry.message = cleanMsg;
+  xSemaphoreTake(logMutex, portMAX_DELAY);
   logBuffer.push_back(entry);
+  logSeq++;
   
   // Ringbuffer: alte Einträge löschen
   if (logBuffer.size() > MAX_LOG_ENTRIES) {
     logBuffer.erase(logBuffer.begin());
   }
+  xSemaphoreGive(logMutex);
   
   // Serial Output mit echter Zeit wenn verfügbar (mit ANSI-Codes)
   if (timeInitialized) {
@@ -171,16 +222,50 @@ void addLog(const String& msg) {
 
 WiFiClient espClient;
 PubSubClient client(espClient);
+
+// ---- MQTT Verbindungszustand ----
+// client.connect() blockiert bei unerreichbarem Broker bis zum TCP- bzw.
+// CONNACK-Timeout. Der Verbindungsaufbau läuft deshalb im Task "mqtt";
+// loop() fasst den Client nur im Zustand MQTT_CONN_UP an.
+enum MqttConnState { MQTT_CONN_DOWN, MQTT_CONN_CONNECTING, MQTT_CONN_DONE, MQTT_CONN_UP };
+volatile MqttConnState mqttConnState = MQTT_CONN_DOWN;
+volatile bool mqttConnectOk = false;    // Ergebnis des letzten Versuchs (gültig in MQTT_CONN_DONE)
+volatile int mqttConnectRc = 0;
+const unsigned long MQTT_BACKOFF_MIN = 1000;   // ms, verdoppelt sich je Fehlversuch
+const unsigned long MQTT_BACKOFF_MAX = 60000;
+const uint32_t MQTT_TASK_STACK = 4096;
+const UBaseType_t MQTT_TASK_PRIORITY = 1;      // wie loop(), blockiert nur im connect()
+const BaseType_t MQTT_TASK_CORE = 1;
+TaskHandle_t mqttTaskHandle = NULL;
+struct MqttConnStats {
+  unsigned long attempts = 0;
+  unsigned long failures = 0;
+  unsigned long lastConnectMs = 0;   // Dauer des letzten Verbindungsversuchs
+  unsigned long maxConnectMs = 0;
+  unsigned long backoffMs = MQTT_BACKOFF_MIN;
+  unsigned long nextAttempt = 0;     // millis() des nächsten Versuchs
+  unsigned long connectStart = 0;
+};
+MqttConnStats mqttConn;
+
+bool mqttConnected() {
+  return mqttConnState == MQTT_CONN_UP && client.connected();
+}
 WebServer server(80);
 const size_t OTA_BUFFER_SIZE = 1460;
 
 // ---- Verlaufsdaten ----
+// measurements enthält nur Unix-Zeitstempel. Messwerte vor der ersten
+// NTP-Synchronisation warten mit millis() in measurementsBeforeNtp und werden
+// umgerechnet übernommen, sobald die Uhr stimmt.
 struct MeasurementData {
   unsigned long timestamp;
   float volume;
 };
 std::vector<MeasurementData> measurements;
-const size_t MAX_MEASUREMENTS = 50;
+std::vector<MeasurementData> measurementsBeforeNtp; // timestamp = millis()
+const size_t MAX_MEASUREMENTS = 2880; // 24 h bei 30 s Intervall, ~23 KB RAM
+const unsigned long HISTORY_MIN_EPOCH = 1609459200UL; // 2021-01-01; kleinere Werte sind millis()
 float lastVolume = -1;
 unsigned long lastMemoryCheck = 0;
 const unsigned long MEMORY_CHECK_INTERVAL = 60000; // Jede Minute
@@ -189,17 +274,290 @@ const unsigned long MEMORY_CHECK_INTERVAL = 60000; // Jede Minute
 HardwareSerial mbusSerial(1); // UART1
 const int MBUS_RX_PIN = 16;   // GPIO16 (RX2) fr ESP32 DevKit V1
 const int MBUS_TX_PIN = 17;   // GPIO17 (TX2) fr ESP32 DevKit V1
-const long MBUS_BAUD = 2400;
+const long MBUS_BAUD = 2400;  // Standardrate, Scan und Rückfall
+const unsigned long MBUS_BAUD_SETTLE = 50;  // ms nach dem ACK, bis der Zähler die neue Rate nutzt
+const uint8_t MBUS_BAUD_MAX_FAILURES = 3;   // danach bleibt der Zähler bis zum Neustart auf 2400
+long mbusCurrentBaud = MBUS_BAUD;
+
+// Zulässige Ziel-Baudraten (mbus_baud)
+bool mbusBaudValid(long baud) {
+  return baud == 300 || baud == 2400 || baud == 9600;
+}
 
 // ---- MBUS State Maschine ----
-enum MBusState { MBUS_IDLE, MBUS_WAIT_RESPONSE };
-MBusState mbusState = MBUS_IDLE;
-unsigned long mbusLastAction = 0;
-const unsigned long MBUS_RESPONSE_TIMEOUT = 500; // ms
-
-uint8_t mbusBuffer[256];
+enum MBusState { MBUS_IDLE, MBUS_WAIT_SELECT, MBUS_WAIT_RESPONSE, MBUS_SCAN_PRIMARY, MBUS_SCAN_SECONDARY,
+                 MBUS_WAIT_BAUD_ACK, MBUS_WAIT_BAUD_FALLBACK, MBUS_WAIT_NKE, MBUS_RETRY_WAIT };
+volatile MBusState mbusState = MBUS_IDLE;
+unsigned long mbusLastAction = 0;  // letztes gesendetes Telegramm
+unsigned long mbusCycleStart = 0;  // Beginn des letzten Abfragezyklus über alle Zähler
+volatile unsigned long mbusPollInterval = 30000; // aktuell gültiges Intervall (fest oder adaptiv)
+AdaptivePollScheduler pollScheduler;             // nur im loop() (Publisher) benutzt
+uint64_t mbusNextAlignedPoll = 0;  // nächste Intervallgrenze in Wanduhr-ms, 0 = neu berechnen
+
+// Abweichung des tatsächlichen Poll-Starts vom geplanten Zeitpunkt
+struct MBusScheduleStats {
+  unsigned long cycles = 0;
+  unsigned long lastJitter = 0;
+  unsigned long maxJitter = 0;
+  unsigned long totalJitter = 0;
+};
+MBusScheduleStats mbusSchedule;
+const unsigned long MBUS_RESPONSE_TIMEOUT = 500; // ms bis zum ersten Byte, solange noch nichts gelernt ist
+const unsigned long MBUS_TIMEOUT_MIN = 100;      // Grenzen für den gelernten Timeout
+const unsigned long MBUS_TIMEOUT_MAX = 1000;
+const unsigned long MBUS_TIMEOUT_MARGIN = 50;    // Zuschlag auf das p99 der Antwortzeit
+const uint32_t MBUS_TIMEOUT_MIN_SAMPLES = 20;
+const uint8_t MBUS_MAX_RETRIES = 2;              // Wiederholungen je Telegramm im selben Poll
+const unsigned long MBUS_RETRY_BACKOFF = 20;     // ms, verdoppelt sich je Wiederholung
+const unsigned long MBUS_INTERBYTE_GAP = 50;     // ms Pause = Telegramm abgebrochen (~10 Zeichen @ 2400)
+const unsigned long MBUS_SCAN_TIMEOUT = 200;     // ms, max. Antwortzeit eines Slaves laut EN 13757-2
+MBusFrameReceiver mbusRx;
+
+uint8_t mbusBuffer[MBUS_CAPTURE_MAX_FRAME];
 size_t mbusLen = 0;
 
+// Mitschnitt der letzten Telegramme (roh, ~4 KB), Download über /api/mbus/capture
+const size_t MBUS_CAPTURE_SLOTS = 16;
+MBusCaptureRing<MBUS_CAPTURE_SLOTS> mbusCapture;
+SemaphoreHandle_t captureMutex = xSemaphoreCreateMutex();
+uint8_t mbusTx[MBUS_SELECT_FRAME_LEN]; // zuletzt gesendetes Telegramm (Echo-Erkennung)
+size_t mbusTxLen = 0;
+MBusGasReading lastReading = {};   // nur im loop() (Publisher) geschrieben
+bool lastReadingValid = false;
+
+// ---- M-Bus Task ----
+// Die State Maschine läuft in einem eigenen Task auf Core 0, loop() (Core 1)
+// übernimmt nur noch MQTT/WebServer. Dekodierte Werte gehen über eine
+// lock-freie Queue an den Publisher, Web-Handler lesen nur Zähler/Flags.
+const uint32_t MBUS_TASK_STACK = 6144;
+const UBaseType_t MBUS_TASK_PRIORITY = 3;  // über loop() (1), unter WiFi/LwIP
+const BaseType_t MBUS_TASK_CORE = 0;
+const TickType_t MBUS_TASK_PERIOD = pdMS_TO_TICKS(2);
+struct MBusReadingMsg {
+  uint8_t meterIndex;
+  MBusGasReading reading;
+  unsigned long startMs;    // Beginn der Auslese (SND_NKE)
+  unsigned long decodedMs;  // letzte Seite dekodiert
+  uint32_t cycle;           // Abfragezyklus, aus dem der Wert stammt
+};
+SpscQueue<MBusReadingMsg, 8> mbusReadings;
+TaskHandle_t mbusTaskHandle = NULL;
+volatile bool mbusTriggerRequested = false; // manuelle Abfrage aus dem WebServer
+volatile uint32_t mbusCyclesDone = 0;       // abgeschlossene Abfragezyklen (nur der Task schreibt)
+volatile uint32_t mbusReadWanted = 0;       // Task startet Zyklen, bis mbusCyclesDone diesen Wert erreicht
+
+// ---- Leseanfragen (HTTP /api/mbus/read, MQTT <topic>_read) ----
+// Anfragen während einer laufenden Auslese hängen sich an denselben Zyklus,
+// Anfragen kurz danach bekommen dessen Ergebnis. So erzeugen gleichzeitige
+// Abfragen aus Home Assistant und Web-UI nur einen Poll auf dem Bus.
+const unsigned long MBUS_READ_COALESCE = 5000;  // ms, so lange gilt ein Ergebnis als frisch
+const unsigned long MBUS_READ_TIMEOUT = 10000;  // ms, max. Wartezeit auf den Zyklus
+enum MBusReadState { MBUS_READ_FRESH, MBUS_READ_PENDING, MBUS_READ_BUSY };
+struct MBusReadStats {
+  unsigned long requests = 0;
+  unsigned long cycles = 0;     // Zyklen, auf die gewartet wurde
+  unsigned long coalesced = 0;  // ohne eigenen Zyklus beantwortet
+  unsigned long timeouts = 0;
+};
+MBusReadStats mbusReadStats;
+uint32_t mbusReadTarget = 0;          // Zyklus, auf den offene Anfragen warten, 0 = keine
+unsigned long mbusReadStarted = 0;
+uint32_t mbusReadCycle = 0;           // letzter für Anfragen abgeschlossener Zyklus
+unsigned long mbusReadCompleted = 0;
+bool mbusReadMqttPending = false;     // Ergebnis zusätzlich auf mqtt_read_result_topic senden
+
+// ---- Zählertabelle (mehrere Zähler an einem Pegelwandler) ----
+const int MBUS_MAX_METERS = 8;
+struct MBusMeter {
+  uint8_t address;       // Primäradresse, MBUS_ADDR_NETWORK bei Sekundäradressierung
+  uint32_t secondaryId;  // Identnummer als BCD-Nibbles (0x12345678), 0 = primär adressiert
+  MBusStats stats;
+  float lastVolume;
+  MqttMeterTopics topics; // Zähler 0 nutzt mqtt_topic, einmal beim Laden der Zählertabelle gebaut
+  long baud;             // ausgehandelte Baudrate (persistiert)
+  uint8_t baudFailures;  // fehlgeschlagene Umschaltungen seit Neustart
+  LatencyHistogram firstByteHist;  // REQ_UD2 gesendet -> Startzeichen der Antwort
+  LatencyHistogram lastByteHist;   // REQ_UD2 gesendet -> Stopzeichen
+  DeadbandFilter volumeFilter;     // pub_change_only: zuletzt gesendete Werte
+  DeadbandFilter rateFilter;
+};
+MBusMeter meters[MBUS_MAX_METERS];
+DeadbandFilter rssiFilter;   // WiFi wird nur mit dem ersten Zähler gesendet
+
+// Zähler für pub_change_only, in /api/diagnostics
+struct PublishStats {
+  PublishCounter volume;  // inkl. Energie
+  PublishCounter wifi;
+  PublishCounter rate;
+  PublishCounter state;   // mqtt_json
+};
+PublishStats publishStats = {};
+
+// Nach einem Reconnect alles einmal vollständig senden
+void publishFiltersReset() {
+  for (int i = 0; i < MBUS_MAX_METERS; i++) {
+    meters[i].volumeFilter.reset();
+    meters[i].rateFilter.reset();
+  }
+  rssiFilter.reset();
+}
+
+// Letzter Messwert je Zähler samt Zyklus, nur im loop() (Publisher) geschrieben
+struct MBusMeterReading {
+  uint32_t cycle;   // 0 = noch kein Wert
+  unsigned long ms;
+  MBusGasReading reading;
+};
+MBusMeterReading meterReadings[MBUS_MAX_METERS] = {};
+Preferences meterPrefs; // eigene Instanz, da aus dem M-Bus Task geschrieben
+int meterCount = 0;
+int mbusCurrentMeter = 0;
+
+// Neue Zählertabelle aus dem Bus-Scan (M-Bus Task), wird von loop() übernommen
+struct MBusMeterTable {
+  int count;
+  uint8_t address[MBUS_MAX_METERS];
+  uint32_t secondaryId[MBUS_MAX_METERS];
+  long baud[MBUS_MAX_METERS];
+};
+MBusMeterTable meterTableNext;
+volatile bool meterTablePending = false;  // Task setzt, loop() löscht nach der Übernahme
+bool mbusBaudAttempted = false; // Umschaltung für den aktuellen Zähler in diesem Zyklus schon versucht
+bool mbusBaudVerify = false;    // laufende Abfrage prüft die neue Baudrate
+
+// ---- Auslese-Sitzung ----
+// SND_NKE setzt den Zähler zurück, danach wechselt das FCB bei jedem quittierten
+// Telegramm. Meldet der Zähler per DIF 0x1F weitere Daten, wird mit gewechseltem
+// FCB die nächste Seite angefordert; jede Seite wird sofort aus mbusBuffer
+// dekodiert, es bleibt nur das zusammengeführte Ergebnis stehen.
+const uint8_t MBUS_MAX_PAGES = 8;
+bool mbusFcb = true;            // FCB für das nächste Telegramm mit FCV
+MBusGasReading mbusSession;     // Ergebnis der laufenden Auslese
+uint8_t mbusRetries = 0;        // Wiederholungen des aktuellen Telegramms
+unsigned long mbusSessionStart = 0;
+unsigned long mbusSessionFirstByte = 0; // REQ_UD2 -> erstes Byte der ersten Seite
+unsigned long mbusSessionResponse = 0;  // Summe REQ_UD2 -> letztes Byte über alle Seiten
+unsigned long mbusRetryDelay = 0;
+bool mbus_scan_enabled = true; // Primär- und Sekundär-Scan beim Start
+
+// Bus-Scan: bekannte Zähler mit abweichender Baudrate zuerst mit ihrer
+// gespeicherten Rate, dann Primäradressen 0..250, danach Tiefensuche über die
+// Identnummer (beides mit der Standardrate)
+struct MBusScanState {
+  int nextKnown;         // nächster Eintrag der bisherigen Zählertabelle
+  int nextPrimary;
+  bool probePending;
+  int primaryCount;
+  uint8_t primary[MBUS_MAX_METERS];
+  long primaryBaud[MBUS_MAX_METERS];
+  int secondaryCount;
+  uint32_t secondary[MBUS_MAX_METERS];
+  long secondaryBaud[MBUS_MAX_METERS];
+  int8_t pos;            // aktuelle Ziffer (0 = höchstwertige), -1 = Deselect vor dem Scan
+  uint8_t digits[8];
+};
+MBusScanState mbusScan;
+
+// ---- Verlauf im LittleFS ----
+// Neue Messwerte werden blockweise an HISTORY_FILE angehängt (8 Bytes je
+// Eintrag); ist die Datei doppelt so lang wie der Verlauf, wird sie neu
+// geschrieben. Ein Verlauf aus den Preferences (ältere Firmware, max. 50
+// Einträge) wird beim ersten Start einmalig übernommen.
+const char* HISTORY_FILE = "/history.bin";
+const char* HISTORY_TMP = "/history.tmp";
+struct HistoryRecord {
+  uint32_t timestamp;
+  float volume;
+};
+bool historyFsReady = false;
+size_t historyFileCount = 0;  // Einträge in HISTORY_FILE
+size_t historyUnsaved = 0;    // neue Einträge am Ende von measurements, noch nicht in der Datei
+
+void historyLoadRecord(unsigned long timestamp, float volume) {
+  // Nur valide Werte laden; millis()-Zeitstempel älterer Firmware verwerfen
+  if (timestamp < HISTORY_MIN_EPOCH || volume < 0 || volume >= 999999) return;
+  measurements.push_back({timestamp, volume});
+  if (measurements.size() > MAX_MEASUREMENTS) measurements.erase(measurements.begin());
+}
+
+// Verlauf der älteren Firmware aus den Preferences lesen und dort löschen
+void historyLoadPrefs() {
+  if (!historyPrefs.begin("gas-history", false)) return;
+  size_t dataCount = min((size_t)historyPrefs.getUInt("count", 0), MAX_MEASUREMENTS);
+  for (size_t i = 0; i < dataCount; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "ts_%u", (unsigned)i);
+    unsigned long timestamp = historyPrefs.getULong(key, 0);
+    snprintf(key, sizeof(key), "vol_%u", (unsigned)i);
+    historyLoadRecord(timestamp, historyPrefs.getFloat(key, 0.0));
+  }
+  if (dataCount > 0) historyPrefs.clear();
+  historyPrefs.end();
+}
+
+void historyWrite(File& f, size_t from, size_t count) {
+  HistoryRecord block[32];
+  while (count > 0) {
+    size_t n = min(count, sizeof(block) / sizeof(block[0]));
+    for (size_t i = 0; i < n; i++) {
+      block[i].timestamp = measurements[from + i].timestamp;
+      block[i].volume = measurements[from + i].volume;
+    }
+    f.write((const uint8_t*)block, n * sizeof(HistoryRecord));
+    from += n;
+    count -= n;
+  }
+}
+
+// Neue Einträge anhängen; rewrite schreibt die Datei aus measurements neu
+void saveHistory(bool rewrite = false) {
+  if (!historyFsReady) return;
+  size_t fresh = min(historyUnsaved, measurements.size());
+  if (historyFileCount + fresh > 2 * MAX_MEASUREMENTS) rewrite = true;
+  if (rewrite) {
+    File f = LittleFS.open(HISTORY_TMP, "w");
+    if (!f) return;
+    historyWrite(f, 0, measurements.size());
+    f.close();
+    LittleFS.remove(HISTORY_FILE);
+    LittleFS.rename(HISTORY_TMP, HISTORY_FILE);
+    historyFileCount = measurements.size();
+  } else {
+    if (fresh == 0) return;
+    File f = LittleFS.open(HISTORY_FILE, "a");
+    if (!f) return;
+    historyWrite(f, measurements.size() - fresh, fresh);
+    f.close();
+    historyFileCount += fresh;
+  }
+  historyUnsaved = 0;
+  Serial.println("History gespeichert: " + String(historyFileCount) + " Eintraege in " + HISTORY_FILE);
+}
+
+void loadHistory() {
+  measurements.clear();
+  measurements.reserve(MAX_MEASUREMENTS + 1);
+  // Ohne Dateisystem-Image wird die Partition formatiert, der Verlauf braucht keins
+  historyFsReady = LittleFS.begin(true);
+  if (!historyFsReady) {
+    Serial.println("WARN: LittleFS nicht verfuegbar - Verlauf nur im RAM");
+    return;
+  }
+  File f = LittleFS.open(HISTORY_FILE, "r");
+  if (f) {
+    historyFileCount = f.size() / sizeof(HistoryRecord);
+    // Nur die neuesten MAX_MEASUREMENTS Einträge lesen
+    if (historyFileCount > MAX_MEASUREMENTS) f.seek((historyFileCount - MAX_MEASUREMENTS) * sizeof(HistoryRecord));
+    HistoryRecord r;
+    while (f.read((uint8_t*)&r, sizeof(r)) == sizeof(r)) historyLoadRecord(r.timestamp, r.volume);
+    f.close();
+  } else {
+    historyLoadPrefs();
+    if (!measurements.empty()) saveHistory(true);
+  }
+  Serial.println("Verlauf geladen: " + String(measurements.size()) + " Messwerte");
+}
+
 // ---- Konfiguration laden/speichern ----
 void loadConfig() {
   if (!preferences.begin("gas-config", false)) {
@@ -223,47 +581,28 @@ void loadConfig() {
   gas_calorific_value = preferences.getFloat("gas_calorific", 10.0);
   gas_correction_factor = preferences.getFloat("gas_correction", 1.0);
   use_static_ip = preferences.getBool("use_static_ip", false);
+  mbus_scan_enabled = preferences.getBool("mbus_scan", true);
+  poll_adaptive = preferences.getBool("poll_adaptive", false);
+  poll_min = preferences.getULong("poll_min", 10000);
+  poll_max = preferences.getULong("poll_max", 600000);
+  poll_align = preferences.getBool("poll_align", false);
+  mqtt_json = preferences.getBool("mqtt_json", false);
+  ha_device_discovery = preferences.getBool("ha_device", false);
+  pub_change_only = preferences.getBool("pub_change", false);
+  pub_heartbeat = preferences.getULong("pub_heartbeat", 300000);
+  if (pub_heartbeat < 30000 || pub_heartbeat > 3600000) pub_heartbeat = 300000;
+  pub_volume_db = preferences.getFloat("pub_volume_db", 0);
+  pub_rssi_db = preferences.getInt("pub_rssi_db", 3);
+  pub_rate_db = preferences.getFloat("pub_rate_db", 1.0);
+  mbus_baud = preferences.getLong("mbus_baud", 2400);
+  if (!mbusBaudValid(mbus_baud)) mbus_baud = 2400;
   preferences.getString("static_ip", static_ip, sizeof(static_ip));
   preferences.getString("static_gateway", static_gateway, sizeof(static_gateway));
   preferences.getString("static_subnet", static_subnet, sizeof(static_subnet));
   preferences.getString("static_dns", static_dns, sizeof(static_dns));
   preferences.end();
   
-  // Verlaufsdaten aus Flash laden
-  // Erst versuchen mit read-write zu oeffnen um Namespace zu erstellen falls noetig
-  if (!historyPrefs.begin("gas-history", false)) {
-    Serial.println("WARN: Konnte gas-history Namespace nicht oeffnen/erstellen");
-  }
-  size_t dataCount = historyPrefs.getUInt("count", 0);
-  
-  // Validierung: Nicht mehr als MAX_MEASUREMENTS laden
-  if (dataCount > MAX_MEASUREMENTS) {
-    Serial.println("WARNUNG: Zu viele gespeicherte Daten (" + String(dataCount) + "), limitiere auf " + String(MAX_MEASUREMENTS));
-    dataCount = MAX_MEASUREMENTS;
-  }
-  
-  if (dataCount > 0) {
-    Serial.println("Lade gespeicherte Verlaufsdaten: " + String(dataCount) + " Eintraege");
-    measurements.clear(); // Sicherstellen dass leer
-    
-    for (size_t i = 0; i < dataCount; i++) {
-      char key[16];
-      
-      snprintf(key, sizeof(key), "ts_%d", i);
-      unsigned long timestamp = historyPrefs.getULong(key, 0);
-      
-      snprintf(key, sizeof(key), "vol_%d", i);
-      float volume = historyPrefs.getFloat(key, 0.0);
-      
-      // Nur valide Werte laden
-      if (timestamp > 0 && volume >= 0 && volume < 999999) {
-        measurements.push_back({timestamp, volume});
-      }
-    }
-    
-    Serial.println("Erfolgreich " + String(measurements.size()) + " Messwerte geladen");
-  }
-  historyPrefs.end();
+  loadHistory();
   
   // Validierung: Poll-Intervall muss zwischen 10s und 5min liegen.
   // Wenn im Flash ein ungültiger (z.B. 0) Wert gespeichert wurde, fallback auf 30s.
@@ -274,6 +613,8 @@ void loadConfig() {
   }
   if (poll_interval > 300000) poll_interval = 300000; // Maximum 5min
   Serial.println("DEBUG loadConfig: poll_interval nach Validierung = " + String(poll_interval) + " ms");
+  if (poll_min < 10000 || poll_min > 300000) poll_min = 10000;
+  if (poll_max < poll_min || poll_max > 3600000) poll_max = max(poll_min, 600000UL); // Maximum 1h
   
   // Wenn noch nie konfiguriert oder SSID leer -> Defaults setzen
   if (!configDone || strlen(ssid) == 0) {
@@ -289,6 +630,10 @@ void loadConfig() {
   
   // Availability Topic generieren
   snprintf(mqtt_availability_topic, sizeof(mqtt_availability_topic), "%s_availability", mqtt_topic);
+  snprintf(mqtt_read_topic, sizeof(mqtt_read_topic), "%s_read", mqtt_topic);
+  snprintf(mqtt_read_result_topic, sizeof(mqtt_read_result_topic), "%s_read_result", mqtt_topic);
+  snprintf(mqtt_wifi_topic, sizeof(mqtt_wifi_topic), "%s_wifi", mqtt_topic);
+  snprintf(mqtt_backlog_topic, sizeof(mqtt_backlog_topic), "%s_backlog", mqtt_topic);
 }
 
 void saveConfig() {
@@ -313,6 +658,19 @@ void saveConfig() {
   preferences.putFloat("gas_calorific", gas_calorific_value);
   preferences.putFloat("gas_correction", gas_correction_factor);
   preferences.putBool("use_static_ip", use_static_ip);
+  preferences.putBool("mbus_scan", mbus_scan_enabled);
+  preferences.putBool("poll_adaptive", poll_adaptive);
+  preferences.putULong("poll_min", poll_min);
+  preferences.putULong("poll_max", poll_max);
+  preferences.putBool("poll_align", poll_align);
+  preferences.putBool("mqtt_json", mqtt_json);
+  preferences.putBool("ha_device", ha_device_discovery);
+  preferences.putBool("pub_change", pub_change_only);
+  preferences.putULong("pub_heartbeat", pub_heartbeat);
+  preferences.putFloat("pub_volume_db", pub_volume_db);
+  preferences.putInt("pub_rssi_db", pub_rssi_db);
+  preferences.putFloat("pub_rate_db", pub_rate_db);
+  preferences.putLong("mbus_baud", mbus_baud);
   preferences.putString("static_ip", static_ip);
   preferences.putString("static_gateway", static_gateway);
   preferences.putString("static_subnet", static_subnet);
@@ -325,37 +683,13 @@ void saveConfig() {
 }
 
 // ---- Persistent Data Storage ----
-void saveHistory() {
-  historyPrefs.begin("gas-history", false);
-  
-  // Alte Daten lschen
-  historyPrefs.clear();
-  
-  // Anzahl speichern
-  size_t saveCount = min(measurements.size(), (size_t)MAX_MEASUREMENTS);
-  historyPrefs.putUInt("count", saveCount);
-  
-  // Neueste Messwerte speichern
-  for (size_t i = 0; i < saveCount; i++) {
-    size_t idx = measurements.size() - saveCount + i; // Die neuesten X Werte
-    char key[16];
-    
-    snprintf(key, sizeof(key), "ts_%d", i);
-    historyPrefs.putULong(key, measurements[idx].timestamp);
-    
-    snprintf(key, sizeof(key), "vol_%d", i);
-    historyPrefs.putFloat(key, measurements[idx].volume);
-  }
-  
-  historyPrefs.end();
-  Serial.println("History gespeichert: " + String(saveCount) + " Eintraege");
-}
-
 // ---- Fehler loggen ----
 void logError(const char* msg) {
+  xSemaphoreTake(logMutex, portMAX_DELAY);
   errorStats.lastError = millis();
   strncpy(errorStats.lastErrorMsg, msg, sizeof(errorStats.lastErrorMsg) - 1);
   errorStats.lastErrorMsg[sizeof(errorStats.lastErrorMsg) - 1] = '\0';
+  xSemaphoreGive(logMutex);
   Serial.print("ERROR: ");
   Serial.println(msg);
 }
@@ -372,8 +706,10 @@ void checkMemory() {
     
     // Notfall: Alte Logs lschen
     if (logBuffer.size() > 20) {
+      xSemaphoreTake(logMutex, portMAX_DELAY);
       size_t oldSize = logBuffer.size();
       logBuffer.erase(logBuffer.begin(), logBuffer.begin() + 10);
+      xSemaphoreGive(logMutex);
       Serial.println("Notfall-Cleanup: " + String(oldSize - logBuffer.size()) + " alte Logs gelscht");
     }
     
@@ -383,7 +719,7 @@ void checkMemory() {
       measurements.erase(measurements.begin(), measurements.begin() + 10);
       Serial.println("Notfall-Cleanup: " + String(oldSize - measurements.size()) + " alte Messwerte gelscht");
       // Flash auch aktualisieren
-      saveHistory();
+      saveHistory(true);
     }
   }
   
@@ -420,7 +756,7 @@ void updateStatusLED() {
       digitalWrite(STATUS_LED_PIN, ledState ? HIGH : LOW);
       lastLedBlink = now;
     }
-  } else if (!client.connected()) {
+  } else if (!mqttConnected()) {
     // Mittleres Blinken: MQTT Problem
     if (now - lastLedBlink >= 500) {
       ledState = !ledState;
@@ -439,6 +775,7 @@ void updateStatusLED() {
 
 // ---- Forward declarations ----
 void startAPMode();
+void sseSendReading(unsigned long timestamp, float volume);
 
 // ---- WLAN Setup ----
 void setup_wifi() {
@@ -514,2128 +851,2098 @@ void startAPMode() {
   apMode = true;
 }
 
-// ---- MQTT Reconnect ----
-void reconnect() {
-  static unsigned long lastAttempt = 0;
-  unsigned long now = millis();
+// ---- Home Assistant Auto-Discovery ----
+// Nach einem Reconnect wird nur gesendet, wenn sich die Discovery-Konfiguration
+// seit dem letzten Mal geändert hat (Hash im Flash), sonst erst, wenn Home
+// Assistant auf homeassistant/status "online" meldet. Die Nachrichten gehen
+// einzeln aus loop() raus, mit HA_DISCOVERY_GAP Abstand statt delay().
+// Payloads werden direkt in den MQTT-Client gestreamt (beginPublish), die
+// Länge liefert ein vorheriger Durchlauf mit CountingPrint.
+const char* const FIRMWARE_VERSION = "2.0.0";
+const char* const HA_STATUS_TOPIC = "homeassistant/status";
+const char* const HA_DEVICE_TOPIC = "homeassistant/device/esp32_gaszaehler/config";
+const unsigned long HA_DISCOVERY_GAP = 100;  // ms zwischen zwei Discovery-Nachrichten
+// Alte Entities mit falscher Schreibweise (gaszahler ohne "e"), einmal je Firmware-Version löschen
+const char* const HA_LEGACY_TOPICS[] = {
+  "homeassistant/sensor/gaszahler_gasverbrauch/config",
+  "homeassistant/sensor/gaszahler_zahlerstand/config",
+  "homeassistant/sensor/gaszahler_wifi/config",
+  "homeassistant/sensor/gaszahler_m_bus_rate/config",
+  "homeassistant/binary_sensor/gaszahler_online/config"
+};
+const int HA_LEGACY_COUNT = sizeof(HA_LEGACY_TOPICS) / sizeof(HA_LEGACY_TOPICS[0]);
+
+struct HaEntity {
+  const char* component;
+  const char* id;          // uniq_id und Objekt-ID
+  const char* name;
+  const char* unit;        // NULL = ohne
+  const char* devClass;
+  const char* stateClass;
+  const char* icon;
+  const char* valueTpl;    // Einzel-Topics
+  const char* jsonKey;     // mqtt_json: Feld im Statustopic
+};
+const HaEntity HA_ENTITIES[] = {
+  {"sensor", "esp32_gaszaehler_zaehlerstand", "Zählerstand", "m³", "gas", "total_increasing", NULL, "{{ value|float }}", "volume"},
+  {"sensor", "esp32_gaszaehler_gasverbrauch", "Gasverbrauch", "kWh", "energy", "total_increasing", NULL, "{{ value|float }}", "energy"},
+  {"sensor", "esp32_gaszaehler_wifi", "WiFi", "dBm", "signal_strength", NULL, NULL, "{{ value }}", "wifi"},
+  {"sensor", "esp32_gaszaehler_mbus", "M-Bus Rate", "%", NULL, NULL, "mdi:check-network", "{{ value }}", "mbus_rate"},
+  {"binary_sensor", "esp32_gaszaehler_online", "Online", NULL, "connectivity", NULL, NULL, NULL, NULL}
+};
+const int HA_ENTITY_COUNT = sizeof(HA_ENTITIES) / sizeof(HA_ENTITIES[0]);
+const int HA_ENTITY_ONLINE = HA_ENTITY_COUNT - 1;
+
+// Ablaufplan: Art im oberen Nibble, Index im unteren
+enum HaStep { HA_STEP_LEGACY_CLEAR, HA_STEP_ENTITY_CONFIG, HA_STEP_ENTITY_MIGRATE, HA_STEP_ENTITY_CLEAR,
+              HA_STEP_DEVICE_CONFIG, HA_STEP_DEVICE_CLEAR };
+uint8_t haPlan[2 * HA_LEGACY_COUNT + 2 * HA_ENTITY_COUNT + 2];
+uint8_t haPlanLen = 0;
+int haDiscoveryStep = -1;          // nächster Schritt im Plan, -1 = nichts offen
+unsigned long haDiscoveryLast = 0;
+bool haCleanupPending = false;
+
+// Zählt nur die Bytes: Länge für beginPublish() vorab bestimmen
+class CountingPrint : public Print {
+ public:
+  size_t count = 0;
+  size_t write(uint8_t) override { count++; return 1; }
+  size_t write(const uint8_t* buffer, size_t size) override { count += size; return size; }
+};
+
+// FNV-1a über alles Gedruckte
+class HashPrint : public Print {
+ public:
+  uint32_t hash = 2166136261UL;
+  size_t write(uint8_t c) override { hash = (hash ^ c) * 16777619UL; return 1; }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    for (size_t i = 0; i < size; i++) hash = (hash ^ buffer[i]) * 16777619UL;
+    return size;
+  }
+};
+
+void haEntityConfigTopic(int i, char* out, size_t len) {
+  snprintf(out, len, "homeassistant/%s/%s/config", HA_ENTITIES[i].component, HA_ENTITIES[i].id);
+}
+
+const char* haEntityStateTopic(int i) {
+  if (i == HA_ENTITY_ONLINE) return mqtt_availability_topic;
+  // Mit mqtt_json lesen alle Sensoren aus dem gemeinsamen Statustopic
+  const MBusMeter& m0 = meters[0];
+  if (mqtt_json) return m0.topics.state;
+  switch (i) {
+    case 0: return mqtt_topic;
+    case 1: return m0.topics.energy;
+    case 2: return mqtt_wifi_topic;
+    default: return m0.topics.rate;
+  }
+}
+
+void haPrintField(Print& out, const char* key, const char* value) {
+  out.print(",\"");
+  out.print(key);
+  out.print("\":\"");
+  out.print(value);
+  out.print("\"");
+}
+
+void haPrintDevice(Print& out) {
+  out.print("{\"ids\":[\"esp32_gas\"],\"name\":\"Gaszähler\",\"mdl\":\"BK-G4\",\"mf\":\"ESP32\"}");
+}
+
+// Felder einer Entity ohne schließende Klammer und ohne "dev"
+void haPrintEntityFields(Print& out, int i) {
+  const HaEntity& e = HA_ENTITIES[i];
+  out.print("\"name\":\"");
+  out.print(e.name);
+  out.print("\"");
+  haPrintField(out, "stat_t", haEntityStateTopic(i));
+  if (i == HA_ENTITY_ONLINE) {
+    haPrintField(out, "pl_on", "online");
+    haPrintField(out, "pl_off", "offline");
+  } else {
+    haPrintField(out, "avty_t", mqtt_availability_topic);
+  }
+  if (e.unit) haPrintField(out, "unit_of_meas", e.unit);
+  if (e.devClass) haPrintField(out, "dev_cla", e.devClass);
+  if (e.stateClass) haPrintField(out, "stat_cla", e.stateClass);
+  if (e.valueTpl) {
+    if (mqtt_json) {
+      out.print(",\"val_tpl\":\"{{ value_json.");
+      out.print(e.jsonKey);
+      out.print(" }}\"");
+    } else {
+      haPrintField(out, "val_tpl", e.valueTpl);
+    }
+  }
+  if (e.icon) haPrintField(out, "ic", e.icon);
+  haPrintField(out, "uniq_id", e.id);
+}
+
+// Einzel-Entity (klassische Discovery)
+void haPrintEntityConfig(Print& out, int i) {
+  out.print("{");
+  haPrintEntityFields(out, i);
+  out.print(",\"dev\":");
+  haPrintDevice(out);
+  out.print("}");
+}
+
+// Ein Payload für das ganze Gerät: Gerät und Herkunft einmal, Entities unter "cmps"
+void haPrintDeviceConfig(Print& out, int) {
+  out.print("{\"dev\":");
+  haPrintDevice(out);
+  out.print(",\"o\":{\"name\":\"ESP32 Gaszähler\",\"sw\":\"");
+  out.print(FIRMWARE_VERSION);
+  out.print("\"},\"cmps\":{");
+  for (int i = 0; i < HA_ENTITY_COUNT; i++) {
+    if (i > 0) out.print(",");
+    out.print("\"");
+    out.print(HA_ENTITIES[i].id);
+    out.print("\":{\"p\":\"");
+    out.print(HA_ENTITIES[i].component);
+    out.print("\",");
+    haPrintEntityFields(out, i);
+    out.print("}");
+  }
+  out.print("}}");
+}
+
+// Retained publish ohne Zwischenpuffer: erst Länge zählen, dann direkt in den Client schreiben
+bool haPublishStream(const char* topic, void (*render)(Print&, int), int arg) {
+  CountingPrint counter;
+  render(counter, arg);
+  if (!client.beginPublish(topic, counter.count, true)) return false;
+  render(client, arg);
+  return client.endPublish() == 1;
+}
+
+uint32_t haDiscoveryHash() {
+  HashPrint h;
+  h.print(ha_device_discovery ? "device" : "entity");
+  if (ha_device_discovery) {
+    haPrintDeviceConfig(h, 0);
+  } else {
+    for (int i = 0; i < HA_ENTITY_COUNT; i++) haPrintEntityConfig(h, i);
+  }
+  return h.hash;
+}
+
+// Discovery einplanen. force: auch bei unveränderter Konfiguration (HA wurde neu gestartet)
+void haDiscoveryRequest(bool force) {
+  preferences.begin("gas-ha", false);
+  uint32_t storedHash = preferences.getUInt("hash", 0);
+  String storedFw = preferences.getString("fw", "");
+  bool storedDevice = preferences.getBool("device", false);
+  preferences.end();
   
-  // Nur alle 5 Sekunden versuchen
-  if (now - lastAttempt < 5000) {
+  haCleanupPending = storedFw != FIRMWARE_VERSION;
+  if (!force && !haCleanupPending && storedHash == haDiscoveryHash()) {
+    addLog("HA Discovery unverändert - nicht erneut gesendet");
     return;
   }
   
-  lastAttempt = now;
-  
-  if (!client.connected()) {
-    String authInfo = (strlen(mqtt_user) > 0) ? " (Auth: " + String(mqtt_user) + ")" : " (ohne Auth)";
-    addLog("MQTT: Verbinde zu " + String(mqtt_server) + ":" + String(mqtt_port) + authInfo);
-    
-    // Last Will Testament fr automatische Offline-Erkennung
-    bool connected = false;
-    if (strlen(mqtt_user) > 0) {
-      // Mit Authentifizierung
-      connected = client.connect(mqtt_client_id, mqtt_user, mqtt_pass, mqtt_availability_topic, 1, true, "offline");
-    } else {
-      // Ohne Authentifizierung
-      connected = client.connect(mqtt_client_id, mqtt_availability_topic, 1, true, "offline");
+  haPlanLen = 0;
+  if (haCleanupPending) {
+    for (int i = 0; i < HA_LEGACY_COUNT; i++) haPlan[haPlanLen++] = (HA_STEP_LEGACY_CLEAR << 4) | i;
+  }
+  if (ha_device_discovery) {
+    // Umstieg von Einzel-Entities laut HA-Doku: migrate_discovery, Gerät, dann alte Topics leeren
+    bool migrate = !storedDevice;
+    if (migrate) {
+      for (int i = 0; i < HA_ENTITY_COUNT; i++) haPlan[haPlanLen++] = (HA_STEP_ENTITY_MIGRATE << 4) | i;
     }
-    
-    if (connected) {
-      addLog("MQTT: Verbunden!");
-      
-      // Online Status senden
-      client.publish(mqtt_availability_topic, "online", true);
-      
-      // Fehler-Counter zurcksetzen bei erfolgreicher Verbindung
-      if (errorStats.mqttErrors > 0) {
-        addLog("MQTT: Verbindung wiederhergestellt (" + String(errorStats.mqttErrors) + " vorherige Fehler)");
-        errorStats.mqttErrors = 0; // Counter zurücksetzen
-      }
-      
-      haDiscoverySent = false; // Discovery neu senden nach Reconnect
-    } else {
-      String errMsg = "MQTT: Fehler rc=" + String(client.state());
-      if (client.state() == 5) errMsg += " (Authentifizierung fehlgeschlagen)";
-      addLog(errMsg);
-      errorStats.mqttErrors++;
-      logError("MQTT Verbindung fehlgeschlagen");
+    haPlan[haPlanLen++] = HA_STEP_DEVICE_CONFIG << 4;
+    if (migrate) {
+      for (int i = 0; i < HA_ENTITY_COUNT; i++) haPlan[haPlanLen++] = (HA_STEP_ENTITY_CLEAR << 4) | i;
     }
+  } else {
+    if (storedDevice) haPlan[haPlanLen++] = HA_STEP_DEVICE_CLEAR << 4;
+    for (int i = 0; i < HA_ENTITY_COUNT; i++) haPlan[haPlanLen++] = (HA_STEP_ENTITY_CONFIG << 4) | i;
   }
+  haDiscoveryStep = 0;
+  haDiscoveryLast = millis() - HA_DISCOVERY_GAP;
 }
 
-// ---- Home Assistant Auto-Discovery ----
-void sendHomeAssistantDiscovery() {
-  if (haDiscoverySent) return;
-  
-  // Alte Entities mit falscher Schreibweise löschen (gaszahler ohne "e")
-  client.publish("homeassistant/sensor/gaszahler_gasverbrauch/config", "", true);
-  client.publish("homeassistant/sensor/gaszahler_zahlerstand/config", "", true);
-  client.publish("homeassistant/sensor/gaszahler_wifi/config", "", true);
-  client.publish("homeassistant/sensor/gaszahler_m_bus_rate/config", "", true);
-  client.publish("homeassistant/binary_sensor/gaszahler_online/config", "", true);
-  delay(300);
-  
-  String dev = "{\"ids\":[\"esp32_gas\"],\"name\":\"Gaszähler\",\"mdl\":\"BK-G4\",\"mf\":\"ESP32\"}";
-  
-  // 1. Gas Volume (m³ auf mqtt_topic)
-  String p1 = "{\"name\":\"Zählerstand\",\"stat_t\":\"" + String(mqtt_topic) + "\",\"avty_t\":\"" + String(mqtt_availability_topic) + "\",\"unit_of_meas\":\"m³\",\"dev_cla\":\"gas\",\"stat_cla\":\"total_increasing\",\"val_tpl\":\"{{ value|float }}\",\"uniq_id\":\"esp32_gaszaehler_zaehlerstand\",\"dev\":" + dev + "}";
-  client.publish("homeassistant/sensor/esp32_gaszaehler_zaehlerstand/config", p1.c_str(), true);
-  delay(100);
-  
-  // 2. Energy (kWh auf mqtt_topic_energy)
-  String p2 = "{\"name\":\"Gasverbrauch\",\"stat_t\":\"" + String(mqtt_topic) + "_energy\",\"avty_t\":\"" + String(mqtt_availability_topic) + "\",\"unit_of_meas\":\"kWh\",\"dev_cla\":\"energy\",\"stat_cla\":\"total_increasing\",\"val_tpl\":\"{{ value|float }}\",\"uniq_id\":\"esp32_gaszaehler_gasverbrauch\",\"dev\":" + dev + "}";
-  client.publish("homeassistant/sensor/esp32_gaszaehler_gasverbrauch/config", p2.c_str(), true);
-  delay(100);
-  
-  // 3. WiFi
-  String p3 = "{\"name\":\"WiFi\",\"stat_t\":\"" + String(mqtt_topic) + "_wifi\",\"avty_t\":\"" + String(mqtt_availability_topic) + "\",\"unit_of_meas\":\"dBm\",\"dev_cla\":\"signal_strength\",\"val_tpl\":\"{{ value }}\",\"uniq_id\":\"esp32_gaszaehler_wifi\",\"dev\":" + dev + "}";
-  client.publish("homeassistant/sensor/esp32_gaszaehler_wifi/config", p3.c_str(), true);
-  delay(100);
-  
-  // 4. M-Bus Rate
-  String p4 = "{\"name\":\"M-Bus Rate\",\"stat_t\":\"" + String(mqtt_topic) + "_mbus_rate\",\"avty_t\":\"" + String(mqtt_availability_topic) + "\",\"unit_of_meas\":\"%\",\"val_tpl\":\"{{ value }}\",\"ic\":\"mdi:check-network\",\"uniq_id\":\"esp32_gaszaehler_mbus\",\"dev\":" + dev + "}";
-  client.publish("homeassistant/sensor/esp32_gaszaehler_mbus/config", p4.c_str(), true);
-  delay(100);
-  
-  // 5. Online
-  String p5 = "{\"name\":\"Online\",\"stat_t\":\"" + String(mqtt_availability_topic) + "\",\"pl_on\":\"online\",\"pl_off\":\"offline\",\"dev_cla\":\"connectivity\",\"uniq_id\":\"esp32_gaszaehler_online\",\"dev\":" + dev + "}";
-  client.publish("homeassistant/binary_sensor/esp32_gaszaehler_online/config", p5.c_str(), true);
-  
-  Serial.println("HA Discovery gesendet (5 Entities)");
+bool haDiscoveryRunStep(uint8_t step) {
+  int i = step & 0x0F;
+  char topic[80];
+  switch (step >> 4) {
+    case HA_STEP_LEGACY_CLEAR:
+      return client.publish(HA_LEGACY_TOPICS[i], "", true);
+    case HA_STEP_ENTITY_CONFIG:
+      haEntityConfigTopic(i, topic, sizeof(topic));
+      return haPublishStream(topic, haPrintEntityConfig, i);
+    case HA_STEP_ENTITY_MIGRATE:
+      haEntityConfigTopic(i, topic, sizeof(topic));
+      return client.publish(topic, "{\"migrate_discovery\":true}", true);
+    case HA_STEP_ENTITY_CLEAR:
+      haEntityConfigTopic(i, topic, sizeof(topic));
+      return client.publish(topic, "", true);
+    case HA_STEP_DEVICE_CONFIG:
+      return haPublishStream(HA_DEVICE_TOPIC, haPrintDeviceConfig, 0);
+    case HA_STEP_DEVICE_CLEAR:
+      return client.publish(HA_DEVICE_TOPIC, "", true);
+  }
+  return true;
+}
+
+// Läuft im loop(): höchstens eine Discovery-Nachricht je HA_DISCOVERY_GAP
+void haDiscoveryProcess(unsigned long now) {
+  if (haDiscoveryStep < 0 || !mqttConnected()) return;
+  if (now - haDiscoveryLast < HA_DISCOVERY_GAP) return;
+  haDiscoveryLast = now;
+  
+  if (!haDiscoveryRunStep(haPlan[haDiscoveryStep])) return; // nächster Versuch nach HA_DISCOVERY_GAP
+  if (++haDiscoveryStep < haPlanLen) return;
+  
+  haDiscoveryStep = -1;
+  preferences.begin("gas-ha", false);
+  preferences.putUInt("hash", haDiscoveryHash());
+  preferences.putBool("device", ha_device_discovery);
+  if (haCleanupPending) preferences.putString("fw", FIRMWARE_VERSION);
+  preferences.end();
+  haCleanupPending = false;
+  
+  String mode = ha_device_discovery ? "Geräte-Payload" : "Einzel-Entities";
+  addLog("HA Discovery gesendet (" + String(HA_ENTITY_COUNT) + " Entities, " + mode + ")");
   Serial.println("Sensoren werden nach der ersten M-Bus Messung sichtbar!");
-  Serial.println("Topics:");
-  Serial.println("  - Volume: " + String(mqtt_topic));
-  Serial.println("  - Energy: " + String(mqtt_topic) + "_energy");
-  Serial.println("  - WiFi: " + String(mqtt_topic) + "_wifi");
-  Serial.println("  - M-Bus Rate: " + String(mqtt_topic) + "_mbus_rate");
   Serial.println("  - Availability: " + String(mqtt_availability_topic));
   Serial.println("Brennwert: " + String(gas_calorific_value, 6) + " kWh/m³, Z-Zahl: " + String(gas_correction_factor, 6));
-  haDiscoverySent = true;
-}
-
-// ---- BCD Parser fr Gaszhler ----
-float parseGasVolumeBCD(const uint8_t* data, size_t len) {
-    for (size_t i = 0; i + 5 < len; i++) {
-        if (data[i] == 0x0C && data[i+1] == 0x13) { // DIF=0x0C, VIF=0x13
-            uint32_t value = 0;
-            uint32_t factor = 1;
-            for (int b = 0; b < 4; b++) {
-                uint8_t byte = data[i+2+b];
-                uint8_t lsn = byte & 0x0F;
-                uint8_t msn = (byte >> 4) & 0x0F;
-                value += lsn * factor; factor *= 10;
-                value += msn * factor; factor *= 10;
-            }
-            return value / 1000.0; // 2 Dezimalstellen  m
-        }
+}
+
+// ---- MQTT Verbindungsaufbau ----
+void mqttTask(void* param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    // Last Will Testament für automatische Offline-Erkennung
+    bool connected;
+    if (strlen(mqtt_user) > 0) {
+      connected = client.connect(mqtt_client_id, mqtt_user, mqtt_pass, mqtt_availability_topic, 1, true, "offline");
+    } else {
+      connected = client.connect(mqtt_client_id, mqtt_availability_topic, 1, true, "offline");
     }
-    return -1; // nicht gefunden
+    mqttConnectRc = client.state();
+    mqttConnectOk = connected;
+    mqttConnState = MQTT_CONN_DONE;
+  }
 }
 
-// ---- OTA Setup ----
-void setupOTA() {
-  ArduinoOTA.setHostname("esp32-gas");
-  ArduinoOTA.onStart([]() { Serial.println("Start OTA Update"); });
-  ArduinoOTA.onEnd([]() { Serial.println("\nOTA Ende"); });
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    Serial.printf("Fortschritt: %u%%\r", (progress / (total / 100)));
-  });
-  ArduinoOTA.onError([](ota_error_t error) {
-    Serial.printf("OTA Fehler[%u]: ", error);
-    if (error == OTA_AUTH_ERROR) Serial.println("Auth fehlgeschlagen");
-    else if (error == OTA_BEGIN_ERROR) Serial.println("Begin fehlgeschlagen");
-    else if (error == OTA_CONNECT_ERROR) Serial.println("Verbindung fehlgeschlagen");
-    else if (error == OTA_RECEIVE_ERROR) Serial.println("Empfang fehlgeschlagen");
-    else if (error == OTA_END_ERROR) Serial.println("End fehlgeschlagen");
-  });
-  ArduinoOTA.begin();
-  Serial.println("OTA bereit");
+// Nächster Versuch nach backoff/2 .. backoff, damit viele Gateways nach einem
+// Broker-Neustart nicht im Gleichschritt verbinden
+void mqttScheduleRetry(unsigned long now) {
+  unsigned long half = mqttConn.backoffMs / 2;
+  mqttConn.nextAttempt = now + half + esp_random() % (half + 1);
+  mqttConn.backoffMs = min(mqttConn.backoffMs * 2, MQTT_BACKOFF_MAX);
 }
 
-// ---- WebServer Handler ----
-const char* htmlPage = R"rawliteral(
-<!DOCTYPE html>
-<html lang="de">
-<head>
-  <meta charset="UTF-8">
-  <meta name="viewport" content="width=device-width, initial-scale=1.0">
-  <title>Gaszaehler Monitor</title>
-  <script src="https://cdn.jsdelivr.net/npm/chart.js@4.4.0/dist/chart.umd.min.js"></script>
-  <script src="https://cdn.jsdelivr.net/npm/chartjs-adapter-date-fns@3.0.0/dist/chartjs-adapter-date-fns.bundle.min.js"></script>
-  <style>
-    * { margin: 0; padding: 0; box-sizing: border-box; }
-    :root {
-      --bg-gradient-start: #4f46e5;
-      --bg-gradient-mid: #7c3aed;
-      --bg-gradient-end: #2563eb;
-      --card-bg: rgba(255, 255, 255, 0.95);
-      --card-shadow: 0 20px 60px rgba(0, 0, 0, 0.15);
-      --card-hover-shadow: 0 25px 70px rgba(0, 0, 0, 0.2);
-      --text-primary: #1f2937;
-      --text-secondary: #6b7280;
-      --text-muted: #9ca3af;
-      --border-color: rgba(229, 231, 235, 0.8);
-      --input-bg: #ffffff;
-      --input-focus-border: #4f46e5;
-      --status-bg: #f9fafb;
-      --accent-gradient: linear-gradient(135deg, #4f46e5 0%, #7c3aed 100%);
-      --success-color: #10b981;
-      --warning-color: #f59e0b;
-      --error-color: #ef4444;
-      --glass-bg: rgba(255, 255, 255, 0.1);
-      --glass-border: rgba(255, 255, 255, 0.2);
-    }
-    body.dark-mode {
-      --bg-gradient-start: #0f172a;
-      --bg-gradient-mid: #1e1b4b;
-      --bg-gradient-end: #1e293b;
-      --card-bg: rgba(30, 41, 59, 0.9);
-      --card-shadow: 0 20px 60px rgba(0, 0, 0, 0.4);
-      --card-hover-shadow: 0 25px 70px rgba(0, 0, 0, 0.5);
-      --text-primary: #f1f5f9;
-      --text-secondary: #cbd5e1;
-      --text-muted: #94a3b8;
-      --border-color: rgba(71, 85, 105, 0.5);
-      --input-bg: rgba(15, 23, 42, 0.6);
-      --input-focus-border: #818cf8;
-      --status-bg: rgba(15, 23, 42, 0.4);
-      --glass-bg: rgba(30, 41, 59, 0.2);
-      --glass-border: rgba(148, 163, 184, 0.1);
-    }
-    
-    @keyframes fadeInUp {
-      from {
-        opacity: 0;
-        transform: translateY(20px);
+// Läuft in jedem loop(): Verbindung überwachen und Versuche anstoßen, ohne zu blockieren
+void mqttManage(unsigned long now) {
+  switch (mqttConnState) {
+    case MQTT_CONN_UP:
+      if (client.connected()) {
+        client.loop();
+        break;
       }
-      to {
-        opacity: 1;
-        transform: translateY(0);
-      }
-    }
-    
-    @keyframes pulse {
-      0%, 100% { opacity: 1; }
-      50% { opacity: 0.6; }
-    }
-    
-    @keyframes slideIn {
-      from {
-        opacity: 0;
-        transform: translateX(-20px);
+      errorStats.mqttErrors++;
+      logError("MQTT Verbindung verloren");
+      mqttConnState = MQTT_CONN_DOWN;
+      mqttConn.backoffMs = MQTT_BACKOFF_MIN;
+      mqttScheduleRetry(now);
+      break;
+      
+    case MQTT_CONN_DOWN:
+      if (WiFi.status() != WL_CONNECTED || !mqttTaskHandle) break;
+      if ((long)(now - mqttConn.nextAttempt) < 0) break;
+      {
+        String authInfo = (strlen(mqtt_user) > 0) ? " (Auth: " + String(mqtt_user) + ")" : " (ohne Auth)";
+        addLog("MQTT: Verbinde zu " + String(mqtt_server) + ":" + String(mqtt_port) + authInfo);
       }
-      to {
-        opacity: 1;
-        transform: translateX(0);
+      mqttConn.attempts++;
+      mqttConn.connectStart = now;
+      mqttConnState = MQTT_CONN_CONNECTING;
+      xTaskNotifyGive(mqttTaskHandle);
+      break;
+      
+    case MQTT_CONN_CONNECTING:
+      break; // Task arbeitet
+      
+    case MQTT_CONN_DONE:
+      mqttConn.lastConnectMs = now - mqttConn.connectStart;
+      if (mqttConn.lastConnectMs > mqttConn.maxConnectMs) mqttConn.maxConnectMs = mqttConn.lastConnectMs;
+      if (mqttConnectOk) {
+        mqttConnState = MQTT_CONN_UP;
+        mqttConn.backoffMs = MQTT_BACKOFF_MIN;
+        addLog("MQTT: Verbunden! (" + String(mqttConn.lastConnectMs) + " ms)");
+        
+        // Online Status senden
+        client.publish(mqtt_availability_topic, "online", true);
+        client.subscribe(mqtt_read_topic);
+        client.subscribe(HA_STATUS_TOPIC);
+        
+        // Fehler-Counter zurücksetzen bei erfolgreicher Verbindung
+        if (errorStats.mqttErrors > 0) {
+          addLog("MQTT: Verbindung wiederhergestellt (" + String(errorStats.mqttErrors) + " vorherige Fehler)");
+          errorStats.mqttErrors = 0; // Counter zurücksetzen
+        }
+        
+        haDiscoveryRequest(false); // nur bei geänderter Konfiguration, sonst auf HA-Birth warten
+        publishFiltersReset();
+      } else {
+        mqttConn.failures++;
+        mqttConnState = MQTT_CONN_DOWN;
+        mqttScheduleRetry(now);
+        String errMsg = "MQTT: Fehler rc=" + String(mqttConnectRc) + " nach " + String(mqttConn.lastConnectMs) + " ms";
+        if (mqttConnectRc == 5) errMsg += " (Authentifizierung fehlgeschlagen)";
+        errMsg += ", nächster Versuch in " + String((mqttConn.nextAttempt - now) / 1000) + "s";
+        addLog(errMsg);
+        errorStats.mqttErrors++;
+        logError("MQTT Verbindung fehlgeschlagen");
       }
+      break;
+  }
+}
+
+// ---- M-Bus Senden/Empfangen ----
+void mbusSend(const uint8_t* frame, size_t len, bool expectAck, unsigned long now) {
+  while (mbusSerial.available()) mbusSerial.read(); // Reste des letzten Zyklus verwerfen
+  mbusSerial.write(frame, len);
+  mbusSerial.flush();
+  mbusTxLen = min(len, sizeof(mbusTx));
+  memcpy(mbusTx, frame, mbusTxLen);
+  mbusLen = 0;
+  mbusRx.begin(mbusBuffer, sizeof(mbusBuffer), expectAck, mbusTx, mbusTxLen);
+  mbusLastAction = now;
+}
+
+// Empfang abarbeiten; true sobald der Zyklus beendet ist: Telegramm komplett,
+// Pause im Bytestrom oder kein erstes Byte innerhalb von timeout
+bool mbusReceive(unsigned long now, unsigned long timeout) {
+  while (mbusSerial.available() && mbusRx.status() == MBUS_RX_PENDING) {
+    mbusRx.feed(mbusSerial.read(), millis());
+  }
+  mbusRx.checkGap(millis(), MBUS_INTERBYTE_GAP);
+  mbusLen = mbusRx.length();
+  return mbusRx.status() != MBUS_RX_PENDING || (!mbusRx.frameStarted() && now - mbusLastAction >= timeout);
+}
+
+void mbusSetBaud(long baud) {
+  if (baud == mbusCurrentBaud) return;
+  mbusSerial.flush();
+  mbusSerial.updateBaudRate(baud);
+  mbusCurrentBaud = baud;
+}
+
+// Antwort erkannt: sauberes 0xE5 oder Kollision mehrerer Zähler (Bytesalat).
+// Ein reines Echo des gesendeten Telegramms zählt nicht.
+bool mbusAnswered() {
+  if (mbusRx.status() == MBUS_RX_COMPLETE) return true;
+  if (!mbusRx.started()) return false;
+  return !(mbusLen <= mbusTxLen && memcmp(mbusBuffer, mbusTx, mbusLen) == 0);
+}
+
+// ---- Zählertabelle ----
+void mbusBuildMeterTopics() {
+  for (int i = 0; i < meterCount; i++) {
+    mqttBuildMeterTopics(meters[i].topics, mqtt_topic, i, meters[i].address, meters[i].secondaryId);
+  }
+}
+
+// Index des Zählers in der aktiven Tabelle, -1 wenn unbekannt
+int mbusFindMeter(uint8_t address, uint32_t secondaryId) {
+  for (int i = 0; i < meterCount; i++) {
+    if (secondaryId ? meters[i].secondaryId == secondaryId : (meters[i].secondaryId == 0 && meters[i].address == address)) return i;
+  }
+  return -1;
+}
+
+// Tabelle neu aufbauen; ohne gefundene Zähler wie bisher Primäradresse 0.
+// Ohne gültige Baudrate (bauds NULL oder 0) übernimmt ein Zähler die Rate des
+// passenden Eintrags der bisherigen Tabelle (gleiche Identnummer bzw. Adresse).
+// Läuft im M-Bus Task, während loop() meters[] für Publish und Web-Handler
+// durchläuft: die neue Tabelle wird daher nur vorbereitet und von loop() über
+// mbusApplyMeterTable() übernommen. Bis dahin startet der Task keinen Zyklus.
+void mbusSetMeters(const uint8_t* addresses, const uint32_t* secondaryIds, const long* bauds, int count) {
+  MBusMeterTable& t = meterTableNext;
+  t.count = 0;
+  for (int i = 0; i < count && t.count < MBUS_MAX_METERS; i++) {
+    t.address[t.count] = addresses[i];
+    t.secondaryId[t.count] = secondaryIds ? secondaryIds[i] : 0;
+    long baud = bauds ? bauds[i] : 0;
+    if (!mbusBaudCI(baud)) {
+      int known = mbusFindMeter(t.address[t.count], t.secondaryId[t.count]);
+      baud = known >= 0 ? meters[known].baud : MBUS_BAUD;
+    }
+    t.baud[t.count] = baud;
+    t.count++;
+  }
+  if (t.count == 0) {
+    t.address[0] = 0;
+    t.secondaryId[0] = 0;
+    t.baud[0] = MBUS_BAUD;
+    t.count = 1;
+  }
+  meterTablePending = true;
+}
+
+// Vorbereitete Tabelle übernehmen; nur aus loop() bzw. setup() vor dem Task-Start
+void mbusApplyMeterTable() {
+  if (!meterTablePending) return;
+  const MBusMeterTable& t = meterTableNext;
+  for (int i = 0; i < t.count; i++) {
+    MBusMeter& m = meters[i];
+    m = MBusMeter();
+    m.address = t.address[i];
+    m.secondaryId = t.secondaryId[i];
+    m.lastVolume = -1;
+    m.baud = t.baud[i];
+    meterReadings[i] = MBusMeterReading();
+  }
+  meterCount = t.count;
+  mbusBuildMeterTopics();
+  meterTablePending = false;
+}
+
+void loadMeters() {
+  uint8_t addresses[MBUS_MAX_METERS];
+  uint32_t secondaryIds[MBUS_MAX_METERS];
+  long bauds[MBUS_MAX_METERS];
+  int count = 0;
+  if (meterPrefs.begin("gas-meters", true)) {
+    count = min((int)meterPrefs.getUChar("count", 0), MBUS_MAX_METERS);
+    for (int i = 0; i < count; i++) {
+      char key[8];
+      snprintf(key, sizeof(key), "a_%d", i);
+      addresses[i] = meterPrefs.getUChar(key, 0);
+      snprintf(key, sizeof(key), "s_%d", i);
+      secondaryIds[i] = meterPrefs.getULong(key, 0);
+      snprintf(key, sizeof(key), "b_%d", i);
+      bauds[i] = meterPrefs.getLong(key, MBUS_BAUD);
+    }
+    meterPrefs.end();
+  }
+  mbusSetMeters(addresses, secondaryIds, bauds, count);
+  mbusApplyMeterTable();
+}
+
+void saveMeterTable(const MBusMeterTable& t) {
+  meterPrefs.begin("gas-meters", false);
+  meterPrefs.clear();
+  meterPrefs.putUChar("count", t.count);
+  for (int i = 0; i < t.count; i++) {
+    char key[8];
+    snprintf(key, sizeof(key), "a_%d", i);
+    meterPrefs.putUChar(key, t.address[i]);
+    snprintf(key, sizeof(key), "s_%d", i);
+    meterPrefs.putULong(key, t.secondaryId[i]);
+    snprintf(key, sizeof(key), "b_%d", i);
+    meterPrefs.putLong(key, t.baud[i]);
+  }
+  meterPrefs.end();
+}
+
+// Aktive Tabelle speichern (nach Baudraten-Wechsel im M-Bus Task)
+void saveMeters() {
+  MBusMeterTable t;
+  t.count = meterCount;
+  for (int i = 0; i < meterCount; i++) {
+    t.address[i] = meters[i].address;
+    t.secondaryId[i] = meters[i].secondaryId;
+    t.baud[i] = meters[i].baud;
+  }
+  saveMeterTable(t);
+}
+
+// ---- Bus-Scan ----
+void mbusStartScan() {
+  mbusScan = MBusScanState();
+  mbusScan.pos = -1;
+  mbusState = MBUS_SCAN_PRIMARY;
+  addLog("M-Bus: Bus-Scan gestartet (Primaeradressen 0-" + String(MBUS_ADDR_MAX_PRIMARY) + ", danach Sekundaeradressen)");
+}
+
+// Selektionsmaske aus den bisher festgelegten Ziffern, Rest Wildcard
+uint32_t mbusScanPattern() {
+  uint32_t pattern = 0xFFFFFFFF;
+  for (int i = 0; i <= mbusScan.pos; i++) {
+    int shift = 28 - 4 * i;
+    pattern = (pattern & ~(0xFUL << shift)) | ((uint32_t)mbusScan.digits[i] << shift);
+  }
+  return pattern;
+}
+
+// Nächster Kandidat der Tiefensuche; false wenn alle Zweige abgearbeitet sind
+bool mbusScanAdvance() {
+  while (mbusScan.pos >= 0) {
+    if (++mbusScan.digits[mbusScan.pos] <= 9) return true;
+    mbusScan.pos--;
+  }
+  return false;
+}
+
+void mbusScanFinish() {
+  // Sekundäradressierung bevorzugen: funktioniert auch bei doppelten Primäradressen
+  if (mbusScan.secondaryCount > 0) {
+    uint8_t addresses[MBUS_MAX_METERS];
+    memset(addresses, MBUS_ADDR_NETWORK, sizeof(addresses));
+    mbusSetMeters(addresses, mbusScan.secondary, mbusScan.secondaryBaud, mbusScan.secondaryCount);
+  } else {
+    mbusSetMeters(mbusScan.primary, NULL, mbusScan.primaryBaud, mbusScan.primaryCount);
+  }
+  saveMeterTable(meterTableNext);
+  addLog("M-Bus: Scan beendet - " + String(mbusScan.primaryCount) + " primaer, " +
+         String(mbusScan.secondaryCount) + " sekundaer gefunden, " + String(meterTableNext.count) + " Zaehler aktiv");
+  mbusState = MBUS_IDLE;
+  mbusCycleStart = millis() - mbusPollInterval; // sofort ersten Zyklus starten
+}
+
+// Gefundenen Zähler in die Scan-Liste aufnehmen; schon mit der gespeicherten
+// Rate gefundene Zähler nicht doppelt
+void mbusScanAddPrimary(uint8_t address, long baud) {
+  for (int i = 0; i < mbusScan.primaryCount; i++) {
+    if (mbusScan.primary[i] == address) return;
+  }
+  if (mbusScan.primaryCount >= MBUS_MAX_METERS) return;
+  mbusScan.primary[mbusScan.primaryCount] = address;
+  mbusScan.primaryBaud[mbusScan.primaryCount++] = baud;
+}
+
+void mbusScanAddSecondary(uint32_t id, long baud) {
+  for (int i = 0; i < mbusScan.secondaryCount; i++) {
+    if (mbusScan.secondary[i] == id) return;
+  }
+  if (mbusScan.secondaryCount >= MBUS_MAX_METERS) return;
+  mbusScan.secondary[mbusScan.secondaryCount] = id;
+  mbusScan.secondaryBaud[mbusScan.secondaryCount++] = baud;
+}
+
+// Bekannte Zähler mit umgeschalteter Baudrate hören den Scan mit der
+// Standardrate nicht: einzeln mit ihrer gespeicherten Rate ansprechen.
+// false sobald alle bekannten Zähler geprüft sind.
+bool mbusScanKnownStep(unsigned long now) {
+  while (mbusScan.nextKnown < meterCount && meters[mbusScan.nextKnown].baud == MBUS_BAUD) mbusScan.nextKnown++;
+  if (mbusScan.nextKnown >= meterCount) {
+    mbusSetBaud(MBUS_BAUD);
+    return false;
+  }
+  const MBusMeter& m = meters[mbusScan.nextKnown];
+  if (!mbusScan.probePending) {
+    uint8_t frame[MBUS_SELECT_FRAME_LEN];
+    mbusSetBaud(m.baud);
+    if (m.secondaryId) {
+      mbusSend(frame, mbusBuildSelectFrame(m.secondaryId, frame), true, now);
+    } else {
+      mbusSend(frame, mbusBuildShortFrame(MBUS_C_SND_NKE, m.address, frame), true, now);
     }
-    
-    body {
-      font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', 'Inter', Roboto, Oxygen, Ubuntu, Cantarell, sans-serif;
-      background: linear-gradient(135deg, var(--bg-gradient-start) 0%, var(--bg-gradient-mid) 50%, var(--bg-gradient-end) 100%);
-      background-attachment: fixed;
-      min-height: 100vh;
-      padding: 20px;
-      transition: all 0.4s cubic-bezier(0.4, 0, 0.2, 1);
-      position: relative;
-      overflow-x: hidden;
-    }
-    
-    body::before {
-      content: '';
-      position: fixed;
-      top: 0;
-      left: 0;
-      right: 0;
-      bottom: 0;
-      background: radial-gradient(circle at 20% 50%, rgba(99, 102, 241, 0.1) 0%, transparent 50%),
-                  radial-gradient(circle at 80% 80%, rgba(168, 85, 247, 0.1) 0%, transparent 50%);
-      pointer-events: none;
-      z-index: 0;
-    }
-    .container {
-      max-width: 1200px;
-      margin: 0 auto;
-      position: relative;
-      z-index: 1;
-    }
-    
-    .header {
-      text-align: center;
-      color: white;
-      margin-bottom: 40px;
-      animation: fadeInUp 0.6s ease-out;
-    }
-    
-    .header h1 {
-      font-size: 3em;
-      font-weight: 800;
-      margin-bottom: 8px;
-      text-shadow: 0 4px 20px rgba(0,0,0,0.3);
-      letter-spacing: -0.02em;
-      color: #ffffff;
-    }
-    
-    .header p {
-      font-size: 1.1em;
-      opacity: 0.95;
-      font-weight: 500;
-      letter-spacing: 0.02em;
-      text-shadow: 0 2px 10px rgba(0,0,0,0.2);
-    }
-    
-    .theme-toggle {
-      position: absolute;
-      top: 0;
-      right: 0;
-      background: var(--glass-bg);
-      backdrop-filter: blur(20px);
-      -webkit-backdrop-filter: blur(20px);
-      border: 1px solid var(--glass-border);
-      padding: 12px 20px;
-      border-radius: 50px;
-      color: white;
-      cursor: pointer;
-      font-size: 1.3em;
-      transition: all 0.3s cubic-bezier(0.4, 0, 0.2, 1);
-      box-shadow: 0 8px 24px rgba(0,0,0,0.15);
-    }
-    
-    .theme-toggle:hover {
-      transform: translateY(-2px) scale(1.05);
-      box-shadow: 0 12px 32px rgba(0,0,0,0.2);
-      background: var(--glass-border);
-    }
-    .nav {
-      display: flex;
-      gap: 12px;
-      justify-content: center;
-      margin-bottom: 30px;
-      flex-wrap: wrap;
-      animation: fadeInUp 0.6s ease-out 0.1s both;
-    }
-    
-    .nav button {
-      background: var(--glass-bg);
-      backdrop-filter: blur(20px);
-      -webkit-backdrop-filter: blur(20px);
-      border: 1px solid var(--glass-border);
-      color: white;
-      padding: 14px 28px;
-      border-radius: 12px;
-      cursor: pointer;
-      font-size: 0.95em;
-      font-weight: 600;
-      transition: all 0.3s cubic-bezier(0.4, 0, 0.2, 1);
-      box-shadow: 0 4px 16px rgba(0,0,0,0.1);
-      letter-spacing: 0.02em;
-    }
-    
-    .nav button:hover {
-      transform: translateY(-3px);
-      box-shadow: 0 8px 24px rgba(0,0,0,0.2);
-      background: var(--glass-border);
-    }
-    
-    .nav button.active {
-      background: linear-gradient(135deg, rgba(255,255,255,0.95) 0%, rgba(255,255,255,0.9) 100%);
-      color: #4f46e5;
-      box-shadow: 0 8px 28px rgba(79, 70, 229, 0.3);
-      border-color: rgba(255,255,255,0.3);
-    }
-    
-    .card {
-      background: var(--card-bg);
-      backdrop-filter: blur(20px);
-      -webkit-backdrop-filter: blur(20px);
-      border-radius: 20px;
-      padding: 30px;
-      margin-bottom: 24px;
-      box-shadow: var(--card-shadow);
-      border: 1px solid var(--glass-border);
-      transition: all 0.4s cubic-bezier(0.4, 0, 0.2, 1);
-      animation: fadeInUp 0.6s ease-out both;
-    }
-    
-    .card:hover {
-      box-shadow: var(--card-hover-shadow);
-      transform: translateY(-4px);
-    }
-    
-    .card h2 {
-      color: var(--text-primary);
-      font-size: 1.75em;
-      font-weight: 700;
-      margin-bottom: 20px;
-      letter-spacing: -0.02em;
-    }
-    
-    .card h3 {
-      color: var(--text-primary);
-      font-size: 1.3em;
-      font-weight: 600;
-      margin-bottom: 15px;
-      margin-top: 25px;
-    }
-    .value-display {
-      text-align: center;
-      padding: 50px 40px;
-      background: var(--accent-gradient);
-      border-radius: 16px;
-      color: white;
-      box-shadow: 0 16px 48px rgba(79, 70, 229, 0.4);
-      position: relative;
-      overflow: hidden;
-    }
-    
-    .value-display::before {
-      content: '';
-      position: absolute;
-      top: -50%;
-      left: -50%;
-      width: 200%;
-      height: 200%;
-      background: radial-gradient(circle, rgba(255,255,255,0.1) 0%, transparent 70%);
-      animation: pulse 3s ease-in-out infinite;
-    }
-    
-    .value-display .label {
-      font-size: 1.3em;
-      opacity: 0.95;
-      margin-bottom: 12px;
-      font-weight: 600;
-      letter-spacing: 0.05em;
-      text-transform: uppercase;
-      position: relative;
-      z-index: 1;
-    }
-    
-    .value-display .value {
-      font-size: 4em;
-      font-weight: 800;
-      text-shadow: 0 4px 20px rgba(0,0,0,0.2);
-      letter-spacing: -0.02em;
-      position: relative;
-      z-index: 1;
-      line-height: 1;
-    }
-    .status-grid {
-      display: grid;
-      grid-template-columns: repeat(auto-fit, minmax(220px, 1fr));
-      gap: 16px;
-      margin-top: 24px;
-    }
-    
-    .status-item {
-      padding: 20px;
-      background: var(--status-bg);
-      border-radius: 12px;
-      border-left: 4px solid var(--input-focus-border);
-      transition: all 0.3s cubic-bezier(0.4, 0, 0.2, 1);
-      position: relative;
-      overflow: hidden;
-    }
-    
-    .status-item::before {
-      content: '';
-      position: absolute;
-      top: 0;
-      left: -100%;
-      width: 100%;
-      height: 100%;
-      background: linear-gradient(90deg, transparent, rgba(79, 70, 229, 0.05), transparent);
-      transition: left 0.5s ease;
-    }
-    
-    .status-item:hover {
-      transform: translateX(4px);
-      box-shadow: 0 8px 24px rgba(0,0,0,0.08);
-    }
-    
-    .status-item:hover::before {
-      left: 100%;
-    }
-    
-    .status-item .label {
-      font-size: 0.85em;
-      color: var(--text-secondary);
-      margin-bottom: 8px;
-      font-weight: 600;
-      text-transform: uppercase;
-      letter-spacing: 0.05em;
-    }
-    
-    .status-item .value {
-      font-size: 1.4em;
-      font-weight: 700;
-      color: var(--text-primary);
-      letter-spacing: -0.01em;
-    }
-    
-    .status-online { 
-      border-left-color: var(--success-color);
-      background: linear-gradient(135deg, rgba(16, 185, 129, 0.05) 0%, var(--status-bg) 100%);
-    }
-    .status-offline { 
-      border-left-color: var(--error-color);
-      background: linear-gradient(135deg, rgba(239, 68, 68, 0.05) 0%, var(--status-bg) 100%);
-    }
-    .chart-container {
-      height: 300px;
-      margin-top: 20px;
-      position: relative;
-      cursor: crosshair;
-    }
-    .chart {
-      width: 100%;
-      height: 100%;
-      touch-action: pan-x pinch-zoom;
-    }
-    .chart-tooltip {
-      position: absolute;
-      background: rgba(0,0,0,0.8);
-      color: white;
-      padding: 8px 12px;
-      border-radius: 6px;
-      font-size: 0.85em;
-      pointer-events: none;
-      display: none;
-      z-index: 1000;
-      white-space: nowrap;
-    }
-    .form-group {
-      margin-bottom: 24px;
-    }
-    
-    .form-group label {
-      display: block;
-      margin-bottom: 8px;
-      font-weight: 600;
-      color: var(--text-primary);
-      font-size: 0.95em;
-      letter-spacing: 0.01em;
-    }
-    
-    .form-group input, .form-group select {
-      width: 100%;
-      padding: 14px 16px;
-      border: 2px solid var(--border-color);
-      border-radius: 10px;
-      font-size: 1em;
-      background: var(--input-bg);
-      color: var(--text-primary);
-      transition: all 0.3s cubic-bezier(0.4, 0, 0.2, 1);
-      font-family: inherit;
-    }
-    
-    .form-group input:focus, .form-group select:focus {
-      outline: none;
-      border-color: var(--input-focus-border);
-      box-shadow: 0 0 0 4px rgba(79, 70, 229, 0.1);
-      transform: translateY(-1px);
-    }
-    
-    .form-group small {
-      display: block;
-      margin-top: 6px;
-      color: var(--text-secondary);
-      font-size: 0.85em;
-      line-height: 1.4;
-    }
-    
-    .btn {
-      background: var(--accent-gradient);
-      color: white;
-      border: none;
-      padding: 14px 32px;
-      border-radius: 10px;
-      font-size: 1em;
-      font-weight: 600;
-      cursor: pointer;
-      transition: all 0.3s cubic-bezier(0.4, 0, 0.2, 1);
-      box-shadow: 0 6px 20px rgba(79, 70, 229, 0.3);
-      letter-spacing: 0.02em;
-    }
-    
-    .btn:hover {
-      transform: translateY(-2px);
-      box-shadow: 0 10px 30px rgba(79, 70, 229, 0.4);
-    }
-    
-    .btn:active {
-      transform: translateY(0);
-      box-shadow: 0 4px 15px rgba(79, 70, 229, 0.3);
-    }
-    
-    .alert {
-      padding: 16px 20px;
-      border-radius: 12px;
-      margin-bottom: 20px;
-      display: none;
-      font-weight: 500;
-      border-left: 4px solid;
-      animation: slideIn 0.3s ease-out;
-    }
-    
-    .alert.success {
-      background: rgba(16, 185, 129, 0.1);
-      color: var(--success-color);
-      border-color: var(--success-color);
+    mbusScan.probePending = true;
+    return true;
+  }
+  if (!mbusReceive(now, MBUS_SCAN_TIMEOUT)) return true;
+  mbusScan.probePending = false;
+  if (mbusRx.status() == MBUS_RX_COMPLETE) {
+    addLog("M-Bus Scan: bekannter Zaehler (Adresse " + String(m.address) + ") antwortet mit " + String(m.baud) + " Baud");
+    if (m.secondaryId) mbusScanAddSecondary(m.secondaryId, m.baud);
+    else mbusScanAddPrimary(m.address, m.baud);
+  }
+  mbusScan.nextKnown++;
+  return true;
+}
+
+void mbusScanStep(unsigned long now) {
+  uint8_t frame[MBUS_SELECT_FRAME_LEN];
+
+  if (mbusState == MBUS_SCAN_PRIMARY) {
+    if (mbusScanKnownStep(now)) return;
+    if (!mbusScan.probePending) {
+      mbusSend(frame, mbusBuildShortFrame(MBUS_C_SND_NKE, mbusScan.nextPrimary, frame), true, now);
+      mbusScan.probePending = true;
+      return;
     }
-    
-    .alert.error {
-      background: rgba(239, 68, 68, 0.1);
-      color: var(--error-color);
-      border-color: var(--error-color);
+    if (!mbusReceive(now, MBUS_SCAN_TIMEOUT)) return;
+    mbusScan.probePending = false;
+    if (mbusAnswered()) {
+      bool collision = mbusRx.status() != MBUS_RX_COMPLETE;
+      addLog("M-Bus Scan: Primaeradresse " + String(mbusScan.nextPrimary) + (collision ? " belegt (Kollision)" : " antwortet"));
+      mbusScanAddPrimary(mbusScan.nextPrimary, MBUS_BAUD);
     }
-    
-    .chart-container {
-      height: 350px;
-      margin-top: 24px;
-      position: relative;
-      cursor: crosshair;
-      border-radius: 12px;
-      overflow: hidden;
+    if (++mbusScan.nextPrimary > MBUS_ADDR_MAX_PRIMARY) mbusState = MBUS_SCAN_SECONDARY;
+    return;
+  }
+
+  // Sekundär-Scan: Tiefensuche über die 8 Ziffern der Identnummer.
+  // Antwort (auch Kollision) -> eine Ziffer tiefer, keine Antwort -> Zweig leer.
+  if (!mbusScan.probePending) {
+    if (mbusScan.pos < 0) {
+      mbusSend(frame, mbusBuildShortFrame(MBUS_C_SND_NKE, MBUS_ADDR_NETWORK, frame), true, now); // alle deselektieren
+    } else {
+      mbusSend(frame, mbusBuildSelectFrame(mbusScanPattern(), frame), true, now);
     }
+    mbusScan.probePending = true;
+    return;
+  }
+  if (!mbusReceive(now, MBUS_SCAN_TIMEOUT)) return;
+  mbusScan.probePending = false;
+
+  if (mbusScan.pos < 0) {
+    mbusScan.pos = 0;
+    mbusScan.digits[0] = 0;
+    return;
+  }
+  bool answered = mbusAnswered();
+  if (answered && mbusScan.pos < 7) {
+    mbusScan.pos++;
+    mbusScan.digits[mbusScan.pos] = 0;
+    return;
+  }
+  if (answered) {
+    uint32_t id = mbusScanPattern();
+    mbusScanAddSecondary(id, MBUS_BAUD);
+    char idStr[9];
+    snprintf(idStr, sizeof(idStr), "%08lX", (unsigned long)id);
+    addLog("M-Bus Scan: Sekundaeradresse " + String(idStr) + " gefunden");
+  }
+  if (!mbusScanAdvance()) mbusScanFinish();
+}
+
+// ---- Zählerabfrage ----
+uint8_t mbusMeterAddress(const MBusMeter& m) {
+  return m.secondaryId ? MBUS_ADDR_NETWORK : m.address;
+}
+
+// Zähler ist ansprechbar (ggf. selektiert): Daten anfordern, vorher einmal pro
+// Zyklus die Baudrate umschalten, falls sie noch nicht der Zielrate entspricht
+void mbusRequestData(unsigned long now) {
+  MBusMeter& m = meters[mbusCurrentMeter];
+  uint8_t frame[MBUS_CONTROL_FRAME_LEN];
+  uint8_t fcb = mbusFcb ? MBUS_C_FCB : 0;
+  uint8_t ci = mbusBaudCI(mbus_baud);
+  if (ci && m.baud != mbus_baud && !mbusBaudAttempted && m.baudFailures < MBUS_BAUD_MAX_FAILURES) {
+    mbusBaudAttempted = true;
+    addLog("M-Bus: Baudrate " + String(m.baud) + " -> " + String(mbus_baud) + " (Adresse " + String(m.address) + ")");
+    mbusSend(frame, mbusBuildControlFrame(MBUS_C_SND_UD | fcb, mbusMeterAddress(m), ci, frame), true, now);
+    mbusState = MBUS_WAIT_BAUD_ACK;
+    return;
+  }
+  mbusSend(frame, mbusBuildShortFrame(MBUS_C_REQ_UD2 | fcb, mbusMeterAddress(m), frame), false, now);
+  mbusState = MBUS_WAIT_RESPONSE;
+}
+
+// Zähler mbusCurrentMeter abfragen: Sitzung mit SND_NKE beginnen. Bei
+// Sekundäradressierung geht SND_NKE an 0xFD und hebt eine alte Selektion auf.
+void mbusStartMeter(unsigned long now) {
+  MBusMeter& m = meters[mbusCurrentMeter];
+  uint8_t frame[MBUS_SHORT_FRAME_LEN];
+  mbusRetries = 0;
+  mbusSessionStart = now;
+  mbusSessionFirstByte = 0;
+  mbusSessionResponse = 0;
+  mbusSetBaud(m.baud);
+  mbusBeginGasReading(mbusSession);
+  mbusSend(frame, mbusBuildShortFrame(MBUS_C_SND_NKE, mbusMeterAddress(m), frame), true, now);
+  mbusState = MBUS_WAIT_NKE;
+}
+
+void mbusStartCycle(unsigned long now) {
+  mbusCycleStart = now;
+  mbusCurrentMeter = 0;
+  mbusBaudAttempted = false;
+  mbusStartMeter(now);
+}
+
+// Nächsten Zähler direkt im Anschluss abfragen, nach dem letzten zurück in IDLE
+void mbusNextMeter(unsigned long now) {
+  mbusBaudAttempted = false;
+  mbusBaudVerify = false;
+  if (++mbusCurrentMeter < meterCount) {
+    mbusStartMeter(now);
+  } else {
+    mbusSetBaud(MBUS_BAUD); // Scan und neue Zähler erwarten die Standardrate
+    mbusCyclesDone++;       // Messwerte des Zyklus liegen bereits in der Queue
+    mbusState = MBUS_IDLE;
+  }
+}
+
+// Timeout bis zum Startzeichen: p99 der bisherigen Antworten plus Zuschlag.
+// Tote Polls scheitern so nach ~100-200 ms statt nach festen 500 ms.
+unsigned long mbusResponseTimeout(const MBusMeter& m) {
+  if (m.firstByteHist.count() < MBUS_TIMEOUT_MIN_SAMPLES) return MBUS_RESPONSE_TIMEOUT;
+  unsigned long t = m.firstByteHist.percentile(99) + MBUS_TIMEOUT_MARGIN;
+  return constrain(t, MBUS_TIMEOUT_MIN, MBUS_TIMEOUT_MAX);
+}
+
+// Wiederholung nur, solange sie samt erwarteter Antwortdauer (p99 letztes Byte)
+// noch vor dem nächsten regulären Poll fertig wird
+bool mbusRetryAllowed(const MBusMeter& m, unsigned long now) {
+  if (mbusRetries >= MBUS_MAX_RETRIES) return false;
+  unsigned long expected = (MBUS_RETRY_BACKOFF << mbusRetries) + mbusResponseTimeout(m) + m.lastByteHist.percentile(99);
+  return now - mbusCycleStart + expected < mbusPollInterval;
+}
+
+// Gleiches Telegramm mit unverändertem FCB erneut senden: hat der Zähler die
+// Anfrage gehört, wiederholt er seine letzte Antwort
+void mbusScheduleRetry(unsigned long now) {
+  mbusRetryDelay = MBUS_RETRY_BACKOFF << mbusRetries;
+  mbusRetries++;
+  errorStats.mbusRetries++;
+  addLog("M-Bus: " + String(mbusLen == 0 ? "Keine Antwort" : "Telegramm defekt") + " - Wiederholung " + String(mbusRetries) + "/" + String(MBUS_MAX_RETRIES));
+  mbusLastAction = now;
+  mbusState = MBUS_RETRY_WAIT;
+}
+
+// Keine gültige Antwort mit der höheren Rate: Zähler auf 2400 Baud zurückschicken.
+// Antwortet er bereits mit 2400, bleibt das Telegramm folgenlos.
+void mbusBaudFallback(unsigned long now) {
+  MBusMeter& m = meters[mbusCurrentMeter];
+  m.baudFailures++;
+  mbusBaudVerify = false;
+  addLog("M-Bus: Keine gueltige Antwort mit " + String(mbusCurrentBaud) + " Baud - zurueck auf " + String(MBUS_BAUD));
+  uint8_t frame[MBUS_CONTROL_FRAME_LEN];
+  uint8_t fcb = mbusFcb ? MBUS_C_FCB : 0;
+  mbusSend(frame, mbusBuildControlFrame(MBUS_C_SND_UD | fcb, mbusMeterAddress(m), mbusBaudCI(MBUS_BAUD), frame), true, now);
+  mbusState = MBUS_WAIT_BAUD_FALLBACK;
+}
+
+void mbusAccountPoll(MBusStats& s, unsigned long firstByteTime, unsigned long responseTime) {
+  s.totalPolls++;
+  s.lastFirstByteTime = firstByteTime;
+  s.lastResponseTime = responseTime;
+  s.totalResponseTime += responseTime;
+  s.avgResponseTime = s.totalResponseTime / s.totalPolls;
+}
+
+// Eine Auslese zählt als ein Poll, egal aus wie vielen Seiten sie besteht;
+// Zeiten einzelner Seiten landen nur in den Latenz-Histogrammen
+void mbusAccountSession(MBusMeter& m) {
+  mbusAccountPoll(mbusStats, mbusSessionFirstByte, mbusSessionResponse);
+  mbusAccountPoll(m.stats, mbusSessionFirstByte, mbusSessionResponse);
+}
+
+// JSON-Status (mqtt_json) wird hier hinein formatiert: kein Heap je Poll
+char mqttStateBuffer[160];
+
+bool mbusPublishStateJson(MBusMeter& m, const MqttReadingValues& v) {
+  int len = mqttFormatState(mqttStateBuffer, sizeof(mqttStateBuffer), v);
+  if (len <= 0 || len >= (int)sizeof(mqttStateBuffer)) return false;
+  if (!client.publish(m.topics.state, (const uint8_t*)mqttStateBuffer, len, true)) return false; // retained!
+  Serial.print("Status gesendet: ");
+  Serial.println(mqttStateBuffer);
+  addLog("MQTT: Status " + String(m.topics.state) + " " + String(mqttStateBuffer));
+  return true;
+}
+
+enum MBusPublishResult { MBUS_PUBLISH_SENT, MBUS_PUBLISH_SUPPRESSED, MBUS_PUBLISH_FAILED };
+
+MqttPublishConfig mqttPublishConfig() {
+  MqttPublishConfig c;
+  c.json = mqtt_json;
+  c.changeOnly = pub_change_only;
+  c.heartbeatMs = pub_heartbeat;
+  c.volumeDb = pub_volume_db;
+  c.rateDb = pub_rate_db;
+  c.rssiDb = pub_rssi_db;
+  c.calorific = gas_calorific_value;
+  c.correction = gas_correction_factor;
+  return c;
+}
+
+void publishDone(DeadbandFilter& f, float value, unsigned long now, PublishCounter& c) {
+  f.published(value, now);
+  c.published++;
+}
+
+MBusPublishResult mbusPublishReading(int meterIndex, float volume) {
+  MBusMeter& m = meters[meterIndex];
+  if (!mqttConnected()) {
+    errorStats.mqttErrors++;
+    addLog("MQTT: nicht verbunden - Messwert nicht gesendet");
+    return MBUS_PUBLISH_FAILED;
+  }
+  unsigned long now = millis();
+  MqttPublishConfig cfg = mqttPublishConfig();
+  MqttReadingValues v;
+  v.volume = volume;
+  v.energy = mqttEnergyKwh(volume, cfg); // Energie für das Energy Dashboard
+  v.rate = m.stats.totalPolls > 0 ? (m.stats.successfulPolls * 100.0 / m.stats.totalPolls) : 0;
+  v.hasRssi = meterIndex == 0;
+  v.rssi = WiFi.RSSI();
+  MqttPublishDue due = mqttPublishDue(cfg, v, m.volumeFilter, m.rateFilter, rssiFilter, now);
+  
+  if (cfg.json) {
+    // Ein Statustopic: senden, sobald irgendein Feld fällig ist
+    if (!due.any()) {
+      publishStats.state.suppressed++;
+      return MBUS_PUBLISH_SUPPRESSED;
+    }
+    if (mbusPublishStateJson(m, v)) {
+      m.volumeFilter.published(v.volume, now);
+      m.rateFilter.published(v.rate, now);
+      if (v.hasRssi) rssiFilter.published(v.rssi, now);
+      publishStats.state.published++;
+      return MBUS_PUBLISH_SENT;
+    }
+    errorStats.mqttErrors++;
+    logError("MQTT Publish fehlgeschlagen");
+    addLog("MQTT: Publish Fehler");
+    return MBUS_PUBLISH_FAILED;
+  }
+  
+  bool sent = false;
+  char value[16];
+  if (due.volume) {
+    char payload[16];
+    mqttFormatVolume(payload, sizeof(payload), v.volume);
     
-    .chart {
-      width: 100%;
-      height: 100%;
-      touch-action: pan-x pinch-zoom;
+    // Volumen publishen (retained so Home Assistant always has latest state)
+    if (!client.publish(m.topics.topic, payload, true)) {
+      errorStats.mqttErrors++;
+      logError("MQTT Publish fehlgeschlagen");
+      addLog("MQTT: Publish Fehler");
+      return MBUS_PUBLISH_FAILED;
+    }
+    Serial.print("Verbrauch gesendet: ");
+    Serial.println(payload);
+    addLog("M-Bus: Verbrauch OK - " + String(payload) + " m³" + (meterCount > 1 ? " (" + String(m.topics.topic) + ")" : String("")));
+    
+    char energy_payload[16];
+    mqttFormatEnergy(energy_payload, sizeof(energy_payload), v.energy);
+    client.publish(m.topics.energy, energy_payload, true); // retained!
+    Serial.print("Energie gesendet: ");
+    Serial.print(energy_payload);
+    Serial.println(" kWh");
+    addLog("MQTT: Energie - " + String(energy_payload) + " kWh (Zählerstand: " + String(payload) + " m³, Brennwert: " + String(gas_calorific_value, 6) + ", Z-Zahl: " + String(gas_correction_factor, 6) + ")");
+    publishDone(m.volumeFilter, v.volume, now, publishStats.volume);
+    sent = true;
+  } else {
+    publishStats.volume.suppressed++;
+  }
+  
+  // Additional HA sensors (nach Energy-Publish)
+  if (due.rssi) {
+    mqttFormatRssi(value, sizeof(value), v.rssi);
+    if (client.publish(mqtt_wifi_topic, value, true)) { // retained!
+      publishDone(rssiFilter, v.rssi, now, publishStats.wifi);
+      sent = true;
     }
-    
-    .chart-tooltip {
-      position: absolute;
-      background: rgba(15, 23, 42, 0.95);
-      backdrop-filter: blur(10px);
-      color: white;
-      padding: 10px 14px;
-      border-radius: 8px;
-      font-size: 0.9em;
-      pointer-events: none;
-      display: none;
-      z-index: 1000;
-      white-space: nowrap;
-      box-shadow: 0 8px 24px rgba(0,0,0,0.3);
-      border: 1px solid rgba(255,255,255,0.1);
+  } else if (v.hasRssi) {
+    publishStats.wifi.suppressed++;
+  }
+  
+  if (due.rate) {
+    mqttFormatRate(value, sizeof(value), v.rate);
+    if (client.publish(m.topics.rate, value, true)) { // retained!
+      publishDone(m.rateFilter, v.rate, now, publishStats.rate);
+      sent = true;
     }
-    
-    .page {
-      display: none;
+  } else {
+    publishStats.rate.suppressed++;
+  }
+  return sent ? MBUS_PUBLISH_SENT : MBUS_PUBLISH_SUPPRESSED;
+}
+
+// ---- Outbox für nicht gesendete Messwerte ----
+// Scheitert der Publish, wandert der Messwert mit Zeitstempel in die Outbox.
+// Je 16 Werte werden als Block in den Flash geschrieben (überlebt Neustarts),
+// nach dem Reconnect gehen sie gedrosselt als JSON auf mqtt_backlog_topic raus.
+const size_t OUTBOX_CHUNK = 16;             // Einträge im RAM = Einträge je Flash-Block
+const uint32_t OUTBOX_FLASH_CHUNKS = 16;    // max. Blöcke im Flash (256 Werte), danach fällt der älteste weg
+const uint32_t OUTBOX_RATE = 2;             // Nachrichten/s beim Abbau
+const uint32_t OUTBOX_BURST = 10;
+const uint8_t OUTBOX_MAX_PER_LOOP = 4;      // loop() bleibt auch bei großem Rückstand reaktionsfähig
+OutboxRing<OUTBOX_CHUNK> outbox;
+OutboxEntry outboxChunk[OUTBOX_CHUNK];      // aus dem Flash geladener Block
+size_t outboxChunkPos = 0;
+size_t outboxChunkLen = 0;
+uint32_t outboxFlashHead = 0;               // Blocknummern im Flash: [head, tail)
+uint32_t outboxFlashTail = 0;
+TokenBucket outboxBucket;
+Preferences outboxPrefs;
+char outboxPayload[192];
+struct OutboxStats {
+  unsigned long queued = 0;
+  unsigned long sent = 0;
+  unsigned long dropped = 0;
+  unsigned long spilled = 0;   // in den Flash geschriebene Blöcke
+};
+OutboxStats outboxStats;
+
+size_t outboxSize() {
+  return outbox.size() + (outboxChunkLen - outboxChunkPos) + (outboxFlashTail - outboxFlashHead) * OUTBOX_CHUNK;
+}
+
+void outboxChunkKey(uint32_t chunk, char* key, size_t len) {
+  snprintf(key, len, "c%u", (unsigned)(chunk % OUTBOX_FLASH_CHUNKS));
+}
+
+void outboxLoad() {
+  outboxPrefs.begin("gas-outbox", false);
+  outboxFlashHead = outboxPrefs.getUInt("head", 0);
+  outboxFlashTail = outboxPrefs.getUInt("tail", 0);
+  outboxPrefs.end();
+  if (outboxFlashTail - outboxFlashHead > OUTBOX_FLASH_CHUNKS) outboxFlashHead = outboxFlashTail = 0;
+  outboxBucket.begin(OUTBOX_RATE, OUTBOX_BURST, millis());
+  if (outboxFlashTail != outboxFlashHead) {
+    addLog("MQTT: Outbox enthält " + String((outboxFlashTail - outboxFlashHead) * OUTBOX_CHUNK) + " Messwerte aus dem Flash");
+  }
+}
+
+// RAM-Ring als Block in den Flash schreiben. Zeitstempel ohne NTP-Zeit
+// werden hier aufgelöst, falls möglich; millis() gilt nach einem Neustart nicht mehr.
+void outboxSpill() {
+  OutboxEntry entries[OUTBOX_CHUNK];
+  size_t n = outbox.take(entries, OUTBOX_CHUNK);
+  if (n == 0) return;
+  unsigned long now = millis();
+  for (size_t i = 0; i < n; i++) {
+    if (entries[i].time == 0 && timeInitialized) entries[i].time = time(nullptr) - (now - entries[i].ms) / 1000;
+    entries[i].ms = 0;
+  }
+  char key[8];
+  outboxPrefs.begin("gas-outbox", false);
+  if (outboxFlashTail - outboxFlashHead >= OUTBOX_FLASH_CHUNKS) {
+    // Flash voll: ältesten Block verwerfen
+    outboxChunkKey(outboxFlashHead, key, sizeof(key));
+    outboxStats.dropped += outboxPrefs.getBytesLength(key) / sizeof(OutboxEntry);
+    outboxPrefs.remove(key);
+    outboxFlashHead++;
+    outboxPrefs.putUInt("head", outboxFlashHead);
+  }
+  outboxChunkKey(outboxFlashTail, key, sizeof(key));
+  if (outboxPrefs.putBytes(key, entries, n * sizeof(OutboxEntry)) == n * sizeof(OutboxEntry)) {
+    outboxFlashTail++;
+    outboxPrefs.putUInt("tail", outboxFlashTail);
+    outboxStats.spilled++;
+  } else {
+    outboxStats.dropped += n;
+    logError("Outbox: Flash-Schreiben fehlgeschlagen");
+  }
+  outboxPrefs.end();
+}
+
+// Uhr ist gestellt: Einträge im RAM über ihr millis()-Alter auf Unixzeit
+// umrechnen, bevor sie ausgelagert werden und millis() seine Bedeutung verliert
+void outboxTimeSynced() {
+  unsigned long now = millis();
+  unsigned long nowSec = time(nullptr);
+  for (size_t i = 0; i < outbox.size(); i++) {
+    OutboxEntry& e = outbox.at(i);
+    if (e.time == 0) e.time = nowSec - (now - e.ms) / 1000;
+  }
+}
+
+void outboxAdd(uint8_t meterIndex, float volume) {
+  if (outbox.full()) outboxSpill();
+  OutboxEntry e = {};
+  e.time = timeInitialized ? time(nullptr) : 0;
+  e.ms = millis();
+  e.volume = volume;
+  e.meter = meterIndex;
+  outbox.push(e);
+  outboxStats.queued++;
+}
+
+// Ältesten Flash-Block in outboxChunk laden und aus dem Flash entfernen
+void outboxLoadChunk() {
+  char key[8];
+  outboxChunkKey(outboxFlashHead, key, sizeof(key));
+  outboxPrefs.begin("gas-outbox", false);
+  size_t bytes = outboxPrefs.getBytes(key, outboxChunk, sizeof(outboxChunk));
+  outboxPrefs.remove(key);
+  outboxFlashHead++;
+  outboxPrefs.putUInt("head", outboxFlashHead);
+  outboxPrefs.end();
+  outboxChunkPos = 0;
+  outboxChunkLen = bytes / sizeof(OutboxEntry);
+}
+
+// Ältester Eintrag: geladener Block, dann weitere Flash-Blöcke, dann RAM
+bool outboxPeek(OutboxEntry& e) {
+  while (outboxChunkPos >= outboxChunkLen && outboxFlashHead != outboxFlashTail) outboxLoadChunk();
+  if (outboxChunkPos < outboxChunkLen) {
+    e = outboxChunk[outboxChunkPos];
+    return true;
+  }
+  if (outbox.empty()) return false;
+  e = outbox.front();
+  return true;
+}
+
+void outboxPop() {
+  if (outboxChunkPos < outboxChunkLen) outboxChunkPos++;
+  else outbox.pop();
+}
+
+// Ohne bekannte Zeit (vor NTP in den Flash ausgelagert) fehlt "ts" im Payload
+bool outboxPublish(const OutboxEntry& e) {
+  uint32_t ts = e.time;
+  if (ts == 0 && e.ms != 0 && timeInitialized) ts = time(nullptr) - (millis() - e.ms) / 1000;
+  const MBusMeter& m = meters[e.meter];
+  float energy = e.volume * gas_calorific_value * gas_correction_factor;
+  int len;
+  if (ts != 0) {
+    len = snprintf(outboxPayload, sizeof(outboxPayload),
+                   "{\"topic\":\"%s\",\"ts\":%lu,\"volume\":%.2f,\"energy\":%.1f}",
+                   m.topics.topic, (unsigned long)ts, e.volume, energy);
+  } else {
+    len = snprintf(outboxPayload, sizeof(outboxPayload),
+                   "{\"topic\":\"%s\",\"volume\":%.2f,\"energy\":%.1f}",
+                   m.topics.topic, e.volume, energy);
+  }
+  if (len <= 0 || len >= (int)sizeof(outboxPayload)) return false;
+  return client.publish(mqtt_backlog_topic, (const uint8_t*)outboxPayload, len, false);
+}
+
+// Läuft im loop(): Rückstand gedrosselt senden, höchstens OUTBOX_MAX_PER_LOOP je Durchlauf
+void outboxDrain(unsigned long now) {
+  if (!mqttConnected()) return;
+  OutboxEntry e;
+  for (uint8_t i = 0; i < OUTBOX_MAX_PER_LOOP && outboxPeek(e); i++) {
+    if (e.meter >= meterCount) {
+      // Zählertabelle wurde inzwischen neu aufgebaut
+      outboxPop();
+      outboxStats.dropped++;
+      continue;
+    }
+    if (!outboxBucket.take(now)) break;
+    if (!outboxPublish(e)) break;
+    outboxPop();
+    outboxStats.sent++;
+    if (outboxSize() == 0) addLog("MQTT: Outbox abgearbeitet (" + String(outboxStats.sent) + " nachgereicht)");
+  }
+}
+
+// Abgeschlossenen Empfangszyklus des aktuellen Zählers auswerten.
+// true: weitere Seite angefordert, Sitzung läuft weiter
+bool mbusHandleResponse(unsigned long now) {
+  MBusMeter& m = meters[mbusCurrentMeter];
+  unsigned long firstByteTime = 0;
+  unsigned long responseTime = now - mbusLastAction;
+  if (mbusRx.frameStarted()) {
+    firstByteTime = mbusRx.frameStartMs() - mbusLastAction;
+    responseTime = mbusRx.lastByteMs() - mbusLastAction;
+  }
+  if (mbusSession.pages == 0) mbusSessionFirstByte = firstByteTime;
+  mbusSessionResponse += responseTime;
+  mbusStats.lastWireTime = m.stats.lastWireTime = mbusWireTimeMs(mbusLen, mbusCurrentBaud);
+  mbusStats.lastBaud = m.stats.lastBaud = mbusCurrentBaud;
+  
+  if (mbusLen == 0) {
+    Serial.println("Keine MBUS Antwort erhalten");
+    errorStats.mbusTimeouts++;
+    logError("M-Bus Timeout");
+    mbusAccountSession(m);
+    return false;
+  }
+  
+  Serial.print("MBUS Antwort empfangen (");
+  Serial.print(mbusLen);
+  Serial.print(" Bytes, ");
+  Serial.print(responseTime);
+  Serial.println("ms)");
+  addLog("M-Bus: Antwort erhalten (" + String(mbusLen) + " Bytes, " + String(responseTime) + "ms)");
+  
+  bool more;
+  unsigned long decodeStart = micros();
+  MBusDecodeResult result = mbusDecodeGasPage(mbusBuffer, mbusLen, mbusSession, more);
+  mbusLatency.decodeUs.add(micros() - decodeStart);
+  if (result == MBUS_DECODE_OK && more && mbusSession.pages < MBUS_MAX_PAGES) {
+    // Seite quittiert: FCB wechseln und Folgetelegramm anfordern
+    mbusFcb = !mbusFcb;
+    addLog("M-Bus: Weitere Daten folgen - fordere Telegramm " + String(mbusSession.pages + 1) + " an");
+    mbusRequestData(now);
+    return true;
+  }
+  mbusAccountSession(m);
+  if (result == MBUS_DECODE_OK && !mbusSession.hasVolume) result = MBUS_DECODE_NO_VOLUME;
+  if (result != MBUS_DECODE_OK) {
+    Serial.println("Kein Volumenwert gefunden: " + String(mbusDecodeResultText(result)));
+    addLog("M-Bus: Telegramm verworfen - " + String(mbusDecodeResultText(result)));
+    errorStats.mbusParseErrors++;
+    logError("M-Bus Parse Fehler");
+    return false;
+  }
+  
+  mbusStats.successfulPolls++;
+  m.stats.successfulPolls++;
+  m.lastVolume = mbusSession.volume;
+  
+  MBusReadingMsg msg;
+  msg.meterIndex = mbusCurrentMeter;
+  msg.reading = mbusSession;
+  msg.startMs = mbusSessionStart;
+  msg.decodedMs = millis();
+  msg.cycle = mbusCyclesDone + 1;
+  if (!mbusReadings.push(msg)) {
+    logError("M-Bus Queue voll - Messwert verworfen");
+  }
+  return false;
+}
+
+// Messwert des ersten Zählers in den Verlauf übernehmen
+void mbusStoreMeasurement(float volume) {
+  lastVolume = volume;
+  if (!timeInitialized) {
+    // Ohne Uhr vormerken, historyTimeSynced() rechnet auf Unix-Zeit um
+    measurementsBeforeNtp.push_back({millis(), volume});
+    if (measurementsBeforeNtp.size() > MAX_MEASUREMENTS) {
+      measurementsBeforeNtp.erase(measurementsBeforeNtp.begin());
     }
-    
-    .page.active {
-      display: block;
-      animation: fadeInUp 0.4s ease-out;
+    return;
+  }
+  unsigned long timestamp = time(nullptr);
+  measurements.push_back({timestamp, volume});
+  historyUnsaved++;
+  if (measurements.size() > MAX_MEASUREMENTS) {
+    measurements.erase(measurements.begin());
+  }
+  sseSendReading(timestamp, volume);
+  
+  // Alle 10 Messungen persistieren
+  static int saveCounter = 0;
+  saveCounter++;
+  if (saveCounter >= 10) {
+    saveHistory();
+    saveCounter = 0;
+  }
+}
+
+// Uhr ist gestellt: vorgemerkte Messwerte mit ihrem Alter einsortieren. Sie
+// stammen aus diesem Betrieb und sind damit neuer als alles in measurements.
+void historyTimeSynced() {
+  if (measurementsBeforeNtp.empty()) return;
+  unsigned long nowMs = millis();
+  unsigned long nowSec = time(nullptr);
+  unsigned long last = measurements.empty() ? 0 : measurements.back().timestamp;
+  for (size_t i = 0; i < measurementsBeforeNtp.size(); i++) {
+    const MeasurementData& m = measurementsBeforeNtp[i];
+    unsigned long timestamp = nowSec - (nowMs - m.timestamp) / 1000;
+    if (timestamp <= last) continue; // Verlauf bleibt streng steigend
+    measurements.push_back({timestamp, m.volume});
+    historyUnsaved++;
+    last = timestamp;
+  }
+  addLog("Zeit: " + String(measurementsBeforeNtp.size()) + " Messwerte vor der NTP-Synchronisation uebernommen");
+  measurementsBeforeNtp.clear();
+  if (measurements.size() > MAX_MEASUREMENTS) {
+    measurements.erase(measurements.begin(), measurements.end() - MAX_MEASUREMENTS);
+  }
+  saveHistory();
+}
+
+// SNTP läuft im Hintergrund weiter: scheitert die Synchronisation beim Start,
+// wird die Uhr hier übernommen, sobald sie gestellt ist
+void timeSyncCheck() {
+  if (timeInitialized || time(nullptr) < (time_t)HISTORY_MIN_EPOCH) return;
+  timeInitialized = true;
+  addLog("Zeit nachtraeglich synchronisiert");
+  historyTimeSynced();
+  outboxTimeSynced();
+}
+
+// Publisher: läuft im loop() und arbeitet die vom M-Bus Task dekodierten Werte ab
+void mbusPublishPending() {
+  MBusReadingMsg msg;
+  while (mbusReadings.pop(msg)) {
+    float volume = msg.reading.volume;
+    lastReading = msg.reading;
+    lastReadingValid = true;
+    MBusMeterReading& r = meterReadings[msg.meterIndex];
+    r.cycle = msg.cycle;
+    r.ms = millis();
+    r.reading = msg.reading;
+    MBusPublishResult published = mbusPublishReading(msg.meterIndex, volume);
+    if (published == MBUS_PUBLISH_SENT) {
+      unsigned long publishedMs = millis();
+      mbusLatency.publish.add(publishedMs - msg.decodedMs);
+      mbusLatency.total.add(publishedMs - msg.startMs);
+    } else if (published == MBUS_PUBLISH_FAILED) {
+      outboxAdd(msg.meterIndex, volume); // wird nach dem Reconnect nachgereicht
+    }
+    
+    // Verlauf und Dashboard zeigen den ersten Zähler
+    if (msg.meterIndex != 0) continue;
+    mbusStoreMeasurement(volume);
+    
+    if (poll_adaptive) {
+      unsigned long next = pollScheduler.update(volume, millis());
+      if (next != mbusPollInterval) {
+        addLog("M-Bus: Poll-Intervall " + String(next / 1000) + "s (Durchfluss " + String(pollScheduler.flowM3h(), 3) + " m3/h)");
+      }
+      mbusPollInterval = next;
     }
-    
-    @media (max-width: 768px) {
-      .header h1 { font-size: 2.2em; }
-      .value-display .value { font-size: 2.8em; }
-      .value-display { padding: 40px 30px; }
-      .nav { gap: 8px; }
-      .nav button { padding: 12px 20px; font-size: 0.9em; }
-      .card { padding: 20px; }
-      .status-grid { grid-template-columns: 1fr; }
+  }
+}
+
+// Ergebnis eines Lese-Zyklus: alle Zähler, die in diesem Zyklus geantwortet haben.
+// Geschrieben wird direkt in die Senke des Writers (HTTP-Chunks bzw. MQTT-Publish).
+void mbusReadJson(JsonWriter& w, bool cached, unsigned long now) {
+  int found = 0;
+  for (int i = 0; i < meterCount; i++) {
+    const MBusMeterReading& r = meterReadings[i];
+    if (r.cycle != 0 && (int32_t)(r.cycle - mbusReadCycle) >= 0) found++; // neuere Zyklen zählen mit
+  }
+  w.beginObject();
+  w.field("cycle", mbusReadCycle);
+  w.field("cached", cached);
+  w.field("age", now - mbusReadCompleted);
+  const MBusMeterReading& r0 = meterReadings[0];
+  if (r0.cycle != 0 && (int32_t)(r0.cycle - mbusReadCycle) >= 0) w.field("volume", r0.reading.volume, 3);
+  w.field("status", found > 0 ? "ok" : "no_response");
+  w.key("meters");
+  w.beginArray();
+  for (int i = 0; i < meterCount; i++) {
+    const MBusMeterReading& r = meterReadings[i];
+    if (r.cycle == 0 || (int32_t)(r.cycle - mbusReadCycle) < 0) continue;
+    w.beginObject();
+    w.field("index", i);
+    w.field("address", meters[i].address);
+    w.field("topic", meters[i].topics.topic);
+    w.field("volume", r.reading.volume, 3);
+    w.field("energy", r.reading.volume * gas_calorific_value * gas_correction_factor, 1);
+    w.field("serial", r.reading.serial);
+    w.field("status", r.reading.status);
+    if (r.reading.hasTimestamp) {
+      char ts[20];
+      const MBusDateTime& t = r.reading.timestamp;
+      snprintf(ts, sizeof(ts), "%04u-%02u-%02uT%02u:%02u", t.year, t.month, t.day, t.hour, t.minute);
+      w.field("meterTime", ts);
+    }
+    w.endObject();
+  }
+  w.endArray();
+  w.endObject();
+}
+
+// Leseanfrage anmelden. FRESH: Ergebnis liegt schon vor (Koaleszenz-Fenster),
+// PENDING: Anfrage hängt am laufenden bzw. nächsten Zyklus, BUSY: Scan läuft.
+MBusReadState mbusReadAttach(unsigned long now) {
+  mbusReadStats.requests++;
+  if (mbusReadCycle != 0 && now - mbusReadCompleted < MBUS_READ_COALESCE) {
+    mbusReadStats.coalesced++;
+    return MBUS_READ_FRESH;
+  }
+  if (mbusReadTarget != 0) {
+    mbusReadStats.coalesced++;
+    return MBUS_READ_PENDING;
+  }
+  if (mbusState == MBUS_SCAN_PRIMARY || mbusState == MBUS_SCAN_SECONDARY) return MBUS_READ_BUSY;
+  // Der nächste abgeschlossene Zyklus: ein gerade laufender oder ein neu angestoßener
+  mbusReadTarget = mbusCyclesDone + 1;
+  mbusReadStarted = now;
+  mbusReadWanted = mbusReadTarget;
+  mbusReadStats.cycles++;
+  return MBUS_READ_PENDING;
+}
+
+// MQTT-Antwort auf <topic>_read. beginPublish braucht die Länge vorab: erst
+// mit einer leeren Senke zählen, dann in Blöcken direkt in den Client schreiben.
+char mqttJsonChunk[256];
+
+void jsonCountSink(void* ctx, const char* data, size_t len) {}
+
+void mqttPublishSink(void* ctx, const char* data, size_t len) {
+  client.write((const uint8_t*)data, len);
+}
+
+void mbusReadPublishResult(bool cached) {
+  if (!mqttConnected()) return;
+  unsigned long now = millis(); // beide Durchläufe müssen dasselbe "age" schreiben
+  JsonWriter count(mqttJsonChunk, sizeof(mqttJsonChunk), jsonCountSink, NULL);
+  mbusReadJson(count, cached, now);
+  count.flush();
+  client.beginPublish(mqtt_read_result_topic, count.bytes(), false);
+  JsonWriter w(mqttJsonChunk, sizeof(mqttJsonChunk), mqttPublishSink, NULL);
+  mbusReadJson(w, cached, now);
+  w.flush();
+  client.endPublish();
+}
+
+void mbusReadPublishStatus(const char* payload) {
+  if (!mqttConnected()) return;
+  client.publish(mqtt_read_result_topic, payload, false);
+}
+
+// Läuft im loop() nach mbusPublishPending(): offene Anfragen abschließen
+void mbusReadService(unsigned long now) {
+  if (mbusReadTarget == 0) return;
+  if ((int32_t)(mbusCyclesDone - mbusReadTarget) >= 0) {
+    mbusPublishPending(); // Messwerte des Zyklus sind vor dem Zykluszähler in der Queue
+    mbusReadCycle = mbusReadTarget;
+    mbusReadCompleted = now;
+    mbusReadTarget = 0;
+    if (mbusReadMqttPending) {
+      mbusReadMqttPending = false;
+      mbusReadPublishResult(false);
+    }
+  } else if (now - mbusReadStarted > MBUS_READ_TIMEOUT) {
+    mbusReadStats.timeouts++;
+    mbusReadTarget = 0;
+    addLog("M-Bus: Leseanfrage ohne Ergebnis (Timeout)");
+    if (mbusReadMqttPending) {
+      mbusReadMqttPending = false;
+      mbusReadPublishStatus("{\"status\":\"timeout\"}");
     }
-    
-    @media (max-width: 480px) {
-      body { padding: 12px; }
-      .header h1 { font-size: 1.8em; }
-      .value-display .value { font-size: 2.2em; }
-      .card h2 { font-size: 1.4em; }
-    }
-  </style>
-</head>
-<body>
-  <div class="container">
-    <div class="header">
-      <button onclick="toggleDarkMode()" id="themeToggle" class="theme-toggle"></button>
-      <h1>🔥 Gaszähler Monitor</h1>
-      <p>ESP32 M-Bus Gateway</p>
-      <div id="apModeWarning" style="display: none; background: var(--glass-bg); backdrop-filter: blur(20px); border: 2px solid var(--warning-color); color: white; padding: 16px 20px; border-radius: 12px; margin-top: 16px; animation: slideIn 0.4s ease-out;">
-        <strong>&#9888; Access Point Modus aktiv!</strong><br>
-        <span style="font-size: 0.9em; opacity: 0.9;">Bitte konfigurieren Sie WLAN unter "Konfiguration" und speichern Sie die Einstellungen.</span>
-      </div>
-    </div>
-
-    <div class="nav">
-      <button onclick="showPage('dashboard')" class="active" id="navDashboard">&#128200; Dashboard</button>
-      <button onclick="showPage('config')" id="navConfig">&#9881; Konfiguration</button>
-      <button onclick="showPage('logs')" id="navLogs">&#128221; Live Logs</button>
-      <button onclick="showPage('diagnostics')" id="navDiagnostics">&#128295; Diagnose</button>
-      <button onclick="showPage('update')" id="navUpdate">&#11014; Firmware Update</button>
-    </div>
-
-    <div id="dashboard" class="page active">
-      <div class="card">
-        <div class="value-display">
-          <div class="label">&#128267; Aktueller Zählerstand</div>
-          <div class="value" id="gasValue">-- m&sup3;</div>
-          <div style="margin-top: 15px; font-size: 1em; opacity: 0.95; font-weight: 600;" id="energyValue">&#9889; -- kWh</div>
-          <div style="margin-top: 20px; padding-top: 15px; border-top: 1px solid rgba(255,255,255,0.2); font-size: 0.85em; opacity: 0.9; display: flex; justify-content: center; gap: 20px;">
-            <span>&#128293; Brennwert: <strong id="calorificDisplay">--</strong> kWh/m³</span>
-            <span>&#9881; Zustandszahl: <strong id="correctionDisplay">--</strong></span>
-          </div>
-        </div>
-      </div>
-
-      <div class="card">
-        <h2>&#128202; System Status</h2>
-        <div class="status-grid">
-          <div class="status-item" id="wifiStatus">
-            <div class="label">&#128246; WLAN</div>
-            <div class="value">--</div>
-          </div>
-          <div class="status-item" id="mqttStatus">
-            <div class="label">&#128228; MQTT</div>
-            <div class="value">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#9201; Uptime</div>
-            <div class="value" id="uptime">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#128336; Letzte Messung</div>
-            <div class="value" id="lastUpdate">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#128337; Poll-Intervall</div>
-            <div class="value" id="pollInterval">--</div>
-          </div>
-          <div class="status-item" id="wifiSignal">
-            <div class="label">&#128246; WLAN Signal</div>
-            <div class="value">--</div>
-          </div>
-        </div>
-      </div>
-
-      <div class="card">
-        <h2>📊 M-Bus Statistik</h2>
-        <div class="status-grid">
-          <div class="status-item">
-            <div class="label">✅ Erfolgsrate</div>
-            <div class="value" id="mbusSuccessRate">--%</div>
-          </div>
-          <div class="status-item">
-            <div class="label">📡 Abfragen Gesamt</div>
-            <div class="value" id="mbusTotal">0</div>
-          </div>
-          <div class="status-item">
-            <div class="label">⏱ Ø Antwortzeit</div>
-            <div class="value" id="mbusAvgTime">-- ms</div>
-          </div>
-          <div class="status-item">
-            <div class="label">⚡ Letzte Antwort</div>
-            <div class="value" id="mbusLastTime">-- ms</div>
-          </div>
-        </div>
-      </div>
-
-      <div class="card">
-        <div style="display: flex; justify-content: space-between; align-items: center; margin-bottom: 20px; flex-wrap: wrap; gap: 15px;">
-          <h2 style="margin: 0;">📈 Verlauf & Statistik</h2>
-          <div style="display: flex; gap: 8px; flex-wrap: wrap;">
-            <button onclick="setTimeRange(24)" class="btn" id="btn24h" style="padding: 8px 16px; font-size: 0.9em;">24h</button>
-            <button onclick="setTimeRange(168)" class="btn active" id="btn7d" style="padding: 8px 16px; font-size: 0.9em;">7d</button>
-            <button onclick="setTimeRange(720)" class="btn" id="btn30d" style="padding: 8px 16px; font-size: 0.9em;">30d</button>
-            <button onclick="setTimeRange(0)" class="btn" id="btnAll" style="padding: 8px 16px; font-size: 0.9em;">Alle</button>
-          </div>
-        </div>
-        
-        <!-- Verbrauchsstatistik -->
-        <div style="display: grid; grid-template-columns: repeat(auto-fit, minmax(150px, 1fr)); gap: 12px; margin-bottom: 20px;">
-          <div style="background: linear-gradient(135deg, rgba(16, 185, 129, 0.1) 0%, rgba(5, 150, 105, 0.1) 100%); border: 1px solid rgba(16, 185, 129, 0.3); border-radius: 10px; padding: 12px; text-align: center;">
-            <div style="color: var(--text-muted); font-size: 0.85em; margin-bottom: 4px;">📅 Heute</div>
-            <div style="color: #10b981; font-size: 1.3em; font-weight: bold;" id="statToday">-- m³</div>
-            <div style="color: var(--text-muted); font-size: 0.75em;" id="statTodayKwh">-- kWh</div>
-          </div>
-          <div style="background: linear-gradient(135deg, rgba(59, 130, 246, 0.1) 0%, rgba(37, 99, 235, 0.1) 100%); border: 1px solid rgba(59, 130, 246, 0.3); border-radius: 10px; padding: 12px; text-align: center;">
-            <div style="color: var(--text-muted); font-size: 0.85em; margin-bottom: 4px;">📆 Diese Woche</div>
-            <div style="color: #3b82f6; font-size: 1.3em; font-weight: bold;" id="statWeek">-- m³</div>
-            <div style="color: var(--text-muted); font-size: 0.75em;" id="statWeekKwh">-- kWh</div>
-          </div>
-          <div style="background: linear-gradient(135deg, rgba(139, 92, 246, 0.1) 0%, rgba(124, 58, 237, 0.1) 100%); border: 1px solid rgba(139, 92, 246, 0.3); border-radius: 10px; padding: 12px; text-align: center;">
-            <div style="color: var(--text-muted); font-size: 0.85em; margin-bottom: 4px;">📅 Dieser Monat</div>
-            <div style="color: #8b5cf6; font-size: 1.3em; font-weight: bold;" id="statMonth">-- m³</div>
-            <div style="color: var(--text-muted); font-size: 0.75em;" id="statMonthKwh">-- kWh</div>
-          </div>
-          <div style="background: linear-gradient(135deg, rgba(251, 191, 36, 0.1) 0%, rgba(245, 158, 11, 0.1) 100%); border: 1px solid rgba(251, 191, 36, 0.3); border-radius: 10px; padding: 12px; text-align: center;">
-            <div style="color: var(--text-muted); font-size: 0.85em; margin-bottom: 4px;">📊 Ø pro Tag</div>
-            <div style="color: #fbbf24; font-size: 1.3em; font-weight: bold;" id="statAvg">-- m³</div>
-            <div style="color: var(--text-muted); font-size: 0.75em;" id="statAvgKwh">-- kWh</div>
-          </div>
-        </div>
-        
-        <div class="chart-container" id="chartContainer">
-          <canvas id="chart" class="chart"></canvas>
-          <div id="chartTooltip" class="chart-tooltip"></div>
-        </div>
-      </div>
-    </div>
-
-    <div id="config" class="page">
-      <div class="card">
-        <h2>&#9881; Einstellungen</h2>
-        <div id="configAlert" class="alert"></div>
-        <form id="configForm" onsubmit="saveConfig(event)">
-          <h3>&#128246; WLAN</h3>
-          <div class="form-group">
-            <label>SSID</label>
-            <div style="display: flex; gap: 10px; align-items: start;">
-              <input type="text" id="ssid" name="ssid" required style="flex: 1;" placeholder="Netzwerkname">
-              <button type="button" onclick="scanWifi()" class="btn" style="padding: 12px 24px; white-space: nowrap;">&#128246; Scannen</button>
-            </div>
-            <select id="wifiList" onchange="selectWifi()" style="width: 100%; padding: 12px; border: 2px solid var(--border-color); border-radius: 10px; margin-top: 10px; display: none; background: var(--input-bg); color: var(--text-primary);">
-              <option value="">-- Netzwerk auswhlen --</option>
-            </select>
-          </div>
-          <div class="form-group">
-            <label>Passwort</label>
-            <div style="position: relative;">
-              <input type="password" id="password" name="password" style="padding-right: 45px;">
-              <button type="button" id="togglePassword" onclick="togglePasswordVisibility('password', 'togglePassword')" style="position: absolute; right: 10px; top: 50%; transform: translateY(-50%); background: none; border: none; cursor: pointer; font-size: 1.1em; color: var(--text-secondary); padding: 4px;">&#9680;</button>
-            </div>
-          </div>
-          <div class="form-group">
-            <label>Hostname</label>
-            <input type="text" id="hostname" name="hostname" required>
-            <small style="color: var(--text-secondary);">Für mDNS (z.B. ESP32-GasZaehler.local)</small>
-          </div>
-          
-          <h3 style="margin-top: 30px;">Netzwerk-Einstellungen</h3>
-          <div class="form-group">
-            <label>
-              <input type="checkbox" id="use_static_ip" name="use_static_ip" style="width: auto; margin-right: 10px;">
-              Static IP verwenden (statt DHCP)
-            </label>
-          </div>
-          <div id="staticIpFields" style="display: none;">
-            <div class="form-group">
-              <label>IP-Adresse</label>
-              <input type="text" id="static_ip" name="static_ip" placeholder="192.168.1.100">
-            </div>
-            <div class="form-group">
-              <label>Gateway</label>
-              <input type="text" id="static_gateway" name="static_gateway" placeholder="192.168.1.1">
-            </div>
-            <div class="form-group">
-              <label>Subnet Mask</label>
-              <input type="text" id="static_subnet" name="static_subnet" placeholder="255.255.255.0">
-            </div>
-            <div class="form-group">
-              <label>DNS Server</label>
-              <input type="text" id="static_dns" name="static_dns" placeholder="192.168.1.1">
-            </div>
-          </div>
-          
-          <h3 style="margin-top: 30px;">MQTT</h3>
-          <div class="form-group">
-            <label>Server IP</label>
-            <input type="text" id="mqtt_server" name="mqtt_server" required>
-          </div>
-          <div class="form-group">
-            <label>Port</label>
-            <input type="number" id="mqtt_port" name="mqtt_port" required>
-          </div>
-          <div class="form-group">
-            <label>Benutzername (optional)</label>
-            <input type="text" id="mqtt_user" name="mqtt_user">
-            <small style="color: var(--text-secondary);">Leer lassen wenn keine Authentifizierung</small>
-          </div>
-          <div class="form-group">
-            <label>Passwort (optional)</label>
-            <div style="position: relative;">
-              <input type="password" id="mqtt_pass" name="mqtt_pass" style="padding-right: 45px;">
-              <button type="button" id="toggleMqttPass" onclick="togglePasswordVisibility('mqtt_pass', 'toggleMqttPass')" style="position: absolute; right: 10px; top: 50%; transform: translateY(-50%); background: none; border: none; cursor: pointer; font-size: 1.1em; color: var(--text-secondary); padding: 4px;">&#9680;</button>
-            </div>
-          </div>
-          <div class="form-group">
-            <label>Topic</label>
-            <input type="text" id="mqtt_topic" name="mqtt_topic" required>
-          </div>
-          
-          <h3 style="margin-top: 30px;">Abfrage-Einstellungen</h3>
-          <div class="form-group">
-            <label>Poll-Intervall (Sekunden)</label>
-            <input type="number" id="poll_interval" name="poll_interval" min="10" max="300" required>
-            <small style="color: #666;">Wie oft der Gaszähler abgefragt wird (10-300 Sekunden)</small>
-          </div>
-          
-          <h3 style="margin-top: 30px;">Energie-Umrechnung (für Home Assistant Energy Dashboard)</h3>
-          <div class="form-group">
-            <label>Brennwert (kWh/m³)</label>
-            <input type="number" id="gas_calorific" name="gas_calorific" step="0.000001" min="8" max="13" required>
-            <small style="color: var(--text-muted);">Brennwert von Erdgas (typisch 10.0-10.5 kWh/m³, siehe Gasrechnung)</small>
-          </div>
-          <div class="form-group">
-            <label>Korrekturfaktor (Z-Zahl)</label>
-            <input type="number" id="gas_correction" name="gas_correction" step="0.000001" min="0.90" max="1.10" required>
-            <small style="color: var(--text-muted);">Zustandszahl für Druck/Temperatur (typisch 0.95-0.97, siehe Gasrechnung)</small>
-          </div>
-          
-          <button type="submit" class="btn" style="width: 100%; padding: 16px; font-size: 1.05em; margin-top: 10px;">&#128190; Speichern & Neustart</button>
-        </form>
-      </div>
-    </div>
-
-    <div id="logs" class="page">
-      <div class="card">
-        <h2>&#128221; Live Logs</h2>
-        <div style="display: flex; justify-content: space-between; align-items: center; margin-bottom: 20px; flex-wrap: wrap; gap: 10px;">
-          <span style="color: var(--text-secondary); font-size: 0.95em;">&#128220; Zeigt die letzten 50 Log-Eintrage</span>
-          <button onclick="refreshLogs()" class="btn" style="padding: 10px 20px;">&#128260; Aktualisieren</button>
-        </div>
-        <div id="logContainer" style="background: var(--status-bg); border-radius: 12px; padding: 20px; max-height: 600px; overflow-y: auto; font-family: 'Consolas', 'Monaco', monospace; font-size: 0.9em; line-height: 1.6; border: 1px solid var(--border-color); color: var(--text-primary);">
-          <div style="text-align: center; color: var(--text-secondary); padding: 20px;">&#128260; Keine Logs vorhanden</div>
-        </div>
-      </div>
-    </div>
-
-    <div id="diagnostics" class="page">
-      <div class="card">
-        <div style="display: flex; justify-content: space-between; align-items: center; margin-bottom: 15px;">
-          <h2 style="margin: 0;">⚠ Fehlerstatistik</h2>
-          <button onclick="resetErrorStats()" class="btn" style="padding: 8px 16px; font-size: 0.9em; background: var(--warning-color);">🗑 Zurücksetzen</button>
-        </div>
-        <div class="status-grid">
-          <div class="status-item">
-            <div class="label">M-Bus Timeouts</div>
-            <div class="value" id="errMbusTimeout">0</div>
-          </div>
-          <div class="status-item">
-            <div class="label">M-Bus Parse-Fehler</div>
-            <div class="value" id="errMbusParse">0</div>
-          </div>
-          <div class="status-item">
-            <div class="label">MQTT Fehler</div>
-            <div class="value" id="errMqtt">0</div>
-          </div>
-          <div class="status-item">
-            <div class="label">WLAN Trennungen</div>
-            <div class="value" id="errWifi">0</div>
-          </div>
-        </div>
-        <div id="lastError" style="margin-top: 15px; padding: 15px; background: var(--status-bg); border-radius: 10px; border-left: 4px solid var(--error-color); display: none;">
-          <strong style="color: var(--text-primary);">&#128681; Letzter Fehler:</strong> <span id="lastErrorMsg" style="color: var(--text-secondary); margin-left: 8px;">--</span>
-        </div>
-      </div>
-
-      <div class="card">
-        <h2>&#128187; System-Informationen</h2>
-        <div class="status-grid">
-          <div class="status-item">
-            <div class="label">&#128190; Freier Heap</div>
-            <div class="value" id="freeHeap">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#128190; Heap-Größe</div>
-            <div class="value" id="heapSize">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#128191; Flash-Größe</div>
-            <div class="value" id="flashSize">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#128191; Sketch-Größe</div>
-            <div class="value" id="sketchSize">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#128191; Freier Flash</div>
-            <div class="value" id="freeFlash">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">&#9889; Chip-Modell</div>
-            <div class="value" id="chipModel">--</div>
-          </div>
-        </div>
-      </div>
-
-      <div class="card">
-        <h2>&#128295; Netzwerk-Diagnose</h2>
-        <div style="display: grid; grid-template-columns: repeat(auto-fit, minmax(250px, 1fr)); gap: 15px; margin-top: 24px;">
-          <button onclick="testMQTT()" class="btn" style="padding: 18px; font-size: 1em;">&#128228; MQTT Verbindung testen</button>
-          <button onclick="testWiFi()" class="btn" style="padding: 18px; font-size: 1em;">&#128246; WiFi Signal prüfen</button>
-          <button onclick="pingGateway()" class="btn" style="padding: 18px; font-size: 1em;">&#127759; Gateway Ping</button>
-          <button onclick="exportData()" class="btn" style="padding: 18px; font-size: 1em;">&#128190; Daten als CSV</button>
-        </div>
-        <div id="diagResult" style="margin-top: 24px; padding: 20px; background: var(--status-bg); border-radius: 12px; font-family: 'Consolas', 'Monaco', monospace; white-space: pre-wrap; display: none; border: 1px solid var(--border-color); line-height: 1.6;"></div>
-      </div>
-
-      <div class="card">
-        <h2>&#128268; M-Bus Diagnose</h2>
-        <div style="margin-bottom: 20px;">
-          <button onclick="refreshMBusData()" class="btn" style="padding: 14px 28px;">&#128260; M-Bus Abfrage starten</button>
-        </div>
-        <div class="status-grid">
-          <div class="status-item">
-            <div class="label">Erfolgsquote</div>
-            <div class="value" id="mbusSuccessRate">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label"> Antwortzeit</div>
-            <div class="value" id="mbusAvgResponse">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">Letzte Antwort</div>
-            <div class="value" id="mbusLastResponse">--</div>
-          </div>
-          <div class="status-item">
-            <div class="label">Gesamt Abfragen</div>
-            <div class="value" id="mbusTotalPolls">--</div>
-          </div>
-        </div>
-        <h3 style="margin-top: 20px;">Letzte M-Bus Rohdaten (Hex)</h3>
-        <div id="mbusHexDump" style="background: var(--status-bg); border-radius: 8px; padding: 15px; font-family: monospace; font-size: 0.85em; word-break: break-all; color: var(--text-secondary);">Keine Daten vorhanden</div>
-      </div>
-
-      <div class="card">
-        <h2> Letzte erfolgreiche Messungen</h2>
-        <div id="lastMeasurements" style="max-height: 300px; overflow-y: auto;">
-          <div style="text-align: center; color: var(--text-muted); padding: 20px;">Lade Daten...</div>
-        </div>
-      </div>
-
-    </div>
-
-    <div id="update" class="page">
-      <div class="card">
-        <h2>&#11014; Firmware Update</h2>
-        
-        <div style="background: linear-gradient(135deg, rgba(99, 102, 241, 0.1) 0%, rgba(168, 85, 247, 0.1) 100%); border: 2px solid #818cf8; border-radius: 12px; padding: 20px; margin-bottom: 24px;">
-          <strong style="color: #818cf8; font-size: 1.1em;">&#9889; OTA Update über PlatformIO (empfohlen)</strong>
-          <p style="margin: 12px 0; color: var(--text-primary); line-height: 1.6;">
-            Der ESP32 unterstützt drahtloses Firmware-Update über das Netzwerk.
-          </p>
-          
-          <div style="background: var(--status-bg); border-radius: 8px; padding: 16px; margin: 16px 0; font-family: 'Courier New', monospace; font-size: 0.9em;">
-            <div style="color: var(--text-primary); margin-bottom: 8px; font-weight: 600;">1. In PlatformIO Terminal:</div>
-            <code style="color: var(--text-primary); display: block; padding: 8px; background: var(--input-bg); border: 1px solid var(--border-color); border-radius: 4px; margin-bottom: 12px;">
-              pio run -t upload --upload-port <span id="currentIP" style="color: #10b981; font-weight: bold;">Lädt...</span>
-            </code>
-            
-            <div style="color: var(--text-primary); margin-bottom: 8px; font-weight: 600;">2. Oder in platformio.ini hinzufügen:</div>
-            <code style="color: var(--text-primary); display: block; padding: 8px; background: var(--input-bg); border: 1px solid var(--border-color); border-radius: 4px; white-space: pre;">upload_protocol = espota
-upload_port = <span id="currentIP2" style="color: #10b981; font-weight: bold;">Lädt...</span></code>
-          </div>
-        </div>
-
-        <div style="background: linear-gradient(135deg, rgba(245, 158, 11, 0.1) 0%, rgba(251, 191, 36, 0.1) 100%); border: 2px solid #fbbf24; border-radius: 12px; padding: 20px; margin-bottom: 24px;">
-          <strong style="color: #fbbf24; font-size: 1.1em;">&#9888; Alternative: USB-Upload</strong>
-          <p style="margin: 12px 0 0 0; color: var(--text-primary); line-height: 1.6;">
-            Bei Problemen mit OTA: ESP32 per USB verbinden und mit <code style="background: var(--status-bg); color: var(--text-primary); padding: 2px 6px; border-radius: 4px;">pio run -t upload</code> flashen.
-          </p>
-        </div>
-
-        <div style="background: linear-gradient(135deg, rgba(99, 102, 241, 0.15) 0%, rgba(168, 85, 247, 0.15) 100%); border: 1px solid #818cf8; border-radius: 12px; padding: 20px; margin-top: 20px;">
-          <div style="color: var(--text-primary); margin-bottom: 12px;"><strong style="color: #818cf8; font-size: 1.1em;">&#128218; Aktuell:</strong></div>
-          <div style="color: var(--text-primary); line-height: 1.8;">
-            <div style="margin-bottom: 8px;">Version: <code style="background: rgba(99, 102, 241, 0.2); color: #818cf8; padding: 4px 10px; border-radius: 6px; font-weight: bold;">2.0.0</code></div>
-            <div style="margin-bottom: 8px;">IP-Adresse: <code id="currentIP3" style="background: rgba(16, 185, 129, 0.2); color: #10b981; padding: 4px 10px; border-radius: 6px; font-weight: bold;">Lädt...</code></div>
-            <div>Hostname: <code style="background: rgba(99, 102, 241, 0.2); color: #818cf8; padding: 4px 10px; border-radius: 6px; font-weight: bold;">esp32-gas.local</code></div>
-          </div>
-        </div>
-      </div>
-    </div>
-  </div>
-
-  <script>
-    let currentPage = 'dashboard';
-    let updateInterval = null;
-    let timeRangeHours = 168;
-    let fullHistoryData = [];
-
-    // Dark Mode initialisieren
-    function initDarkMode() {
-      const darkMode = localStorage.getItem('darkMode') !== 'false'; // Default: true
-      if (darkMode) {
-        document.body.classList.add('dark-mode');
-        document.getElementById('themeToggle').textContent = '';
-        localStorage.setItem('darkMode', 'true');
-      } else {
-        document.getElementById('themeToggle').textContent = '';
-      }
+  }
+}
+
+// MQTT Kommando <topic>_read: Payload wird ignoriert, Antwort auf <topic>_read_result.
+// homeassistant/status "online": Home Assistant ist (neu) gestartet, Discovery erneut senden.
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  if (strcmp(topic, HA_STATUS_TOPIC) == 0) {
+    if (length == 6 && memcmp(payload, "online", 6) == 0) {
+      addLog("MQTT: Home Assistant online - sende Discovery");
+      haDiscoveryRequest(true);
     }
+    return;
+  }
+  if (strcmp(topic, mqtt_read_topic) != 0) return;
+  switch (mbusReadAttach(millis())) {
+    case MBUS_READ_FRESH:
+      mbusReadPublishResult(true);
+      break;
+    case MBUS_READ_PENDING:
+      mbusReadMqttPending = true;
+      break;
+    case MBUS_READ_BUSY:
+      mbusReadPublishStatus("{\"status\":\"busy\"}");
+      break;
+  }
+}
+
+uint64_t mbusWallMs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
+// Prüft, ob der nächste reguläre Zyklus fällig ist. Geplant wird immer vom
+// Sollzeitpunkt aus, nicht vom tatsächlichen Start, damit sich Verzögerungen
+// durch Task-Periode und Zyklusdauer nicht aufsummieren.
+bool mbusPollDue(unsigned long now, unsigned long& lateness) {
+  if (poll_align && timeInitialized) {
+    uint64_t wall = mbusWallMs();
+    // Grenze neu bestimmen, wenn sie mehr als ein Intervall entfernt liegt: die
+    // Uhr ist zurückgesprungen oder das (adaptive) Intervall wurde kürzer
+    if (mbusNextAlignedPoll == 0 || (mbusNextAlignedPoll > wall && mbusNextAlignedPoll - wall > mbusPollInterval)) {
+      mbusNextAlignedPoll = (wall / mbusPollInterval + 1) * mbusPollInterval;
+    }
+    if (wall < mbusNextAlignedPoll) return false;
+    lateness = (unsigned long)(wall - mbusNextAlignedPoll);
+    // Nächste Grenze mit dem aktuellen (ggf. adaptiven) Intervall, verpasste Grenzen überspringen
+    mbusNextAlignedPoll = (wall / mbusPollInterval + 1) * mbusPollInterval;
+    return true;
+  }
+  if (now - mbusCycleStart < mbusPollInterval) return false;
+  lateness = now - mbusCycleStart - mbusPollInterval;
+  return true;
+}
+
+void mbusRecordJitter(unsigned long lateness) {
+  mbusSchedule.cycles++;
+  mbusSchedule.lastJitter = lateness;
+  mbusSchedule.totalJitter += lateness;
+  if (lateness > mbusSchedule.maxJitter) mbusSchedule.maxJitter = lateness;
+}
+
+void mbusProcess(unsigned long now) {
+  if (mbusLatencyResetRequested) {
+    mbusLatency.firstByte.reset();
+    mbusLatency.transfer.reset();
+    mbusLatency.decodeUs.reset();
+    mbusLatencyResetRequested = false;
+  }
+  switch (mbusState) {
+    case MBUS_SCAN_PRIMARY:
+    case MBUS_SCAN_SECONDARY:
+      mbusScanStep(now);
+      break;
 
-    function toggleDarkMode() {
-      const isDark = document.body.classList.toggle('dark-mode');
-      localStorage.setItem('darkMode', isDark);
-      document.getElementById('themeToggle').textContent = isDark ? '' : '';
-      
-      // Chart neu zeichnen fr Theme-Anpassung
-      if (currentPage === 'dashboard' && fullHistoryData.length > 0) {
-        drawChart(filterHistoryByTimeRange(fullHistoryData));
+    case MBUS_IDLE: {
+      if (meterTablePending) break;  // neue Zählertabelle noch nicht von loop() übernommen
+      unsigned long lateness = 0;
+      bool due = mbusPollDue(now, lateness);
+      bool wanted = (int32_t)(mbusReadWanted - mbusCyclesDone) > 0;
+      if (mbusTriggerRequested || due || wanted) {
+        mbusTriggerRequested = false;
+        mbusStartCycle(now);
+        if (due) {
+          mbusRecordJitter(lateness);
+          // Ohne Uhr-Ausrichtung: Takt vom Sollzeitpunkt weiterzählen (außer nach langer Pause)
+          if (lateness < mbusPollInterval) mbusCycleStart = now - lateness;
+        }
+        Serial.println("MBUS Poll gesendet, warte auf Antwort...");
+        addLog("M-Bus: Poll gestartet" + (meterCount > 1 ? " (" + String(meterCount) + " Zaehler)" : String("")));
       }
+      break;
     }
 
-    function togglePasswordVisibility(fieldId, buttonId) {
-      const field = document.getElementById(fieldId);
-      const button = document.getElementById(buttonId);
-      if (field.type === 'password') {
-        field.type = 'text';
-        button.textContent = '\u25CB'; // Open circle
+    case MBUS_WAIT_NKE: {
+      // Quittung abwarten; ohne Antwort trotzdem weiter, der Datenabruf entscheidet
+      if (!mbusReceive(now, MBUS_SCAN_TIMEOUT)) break;
+      MBusMeter& m = meters[mbusCurrentMeter];
+      mbusFcb = true;
+      if (m.secondaryId) {
+        uint8_t frame[MBUS_SELECT_FRAME_LEN];
+        mbusSend(frame, mbusBuildSelectFrame(m.secondaryId, frame), true, now);
+        mbusState = MBUS_WAIT_SELECT;
       } else {
-        field.type = 'password';
-        button.textContent = '\u25C0'; // Filled circle
+        mbusRequestData(now);
       }
+      break;
     }
 
-    function showPage(page) {
-      document.querySelectorAll('.page').forEach(p => p.classList.remove('active'));
-      document.querySelectorAll('.nav button').forEach(b => b.classList.remove('active'));
-      document.getElementById(page).classList.add('active');
-      document.getElementById('nav' + page.charAt(0).toUpperCase() + page.slice(1)).classList.add('active');
-      currentPage = page;
-      
-      if (page === 'dashboard') {
-        if (updateInterval) clearInterval(updateInterval);
-        updateData();
+    case MBUS_WAIT_SELECT:
+      if (!mbusReceive(now, MBUS_SCAN_TIMEOUT)) break;
+      if (mbusRx.status() == MBUS_RX_COMPLETE) {
+        mbusFcb = true; // Selektion wurde mit FCB=0 gesendet
+        mbusRequestData(now);
       } else {
-        if (updateInterval) clearInterval(updateInterval);
-        if (page === 'config') loadConfig();
-        if (page === 'logs') {
-          refreshLogs();
-          updateInterval = setInterval(refreshLogs, 3000);
-        }
-        if (page === 'diagnostics') {
-          refreshMBusData();
-          fetch('/api/data').then(r => r.json()).then(data => {
-            if (data.history && data.history.length > 0) {
-              let html = '<div style="display: grid; gap: 10px;">';
-              data.history.slice(-10).reverse().forEach(point => {
-                const date = new Date(point.timestamp * 1000);
-                const energy = (point.volume * data.calorific * data.correction).toFixed(3);
-                html += `<div style="padding: 10px; background: var(--status-bg); border-radius: 5px; display: flex; justify-content: space-between;">`;
-                html += `<span style="color: var(--text-secondary);">${date.toLocaleString('de-DE')}</span>`;
-                html += `<strong style="color: var(--text-primary);">${point.volume.toFixed(2)} m³ / ${energy} kWh</strong>`;
-                html += `</div>`;
-              });
-              html += '</div>';
-              const el = document.getElementById('lastMeasurements');
-              if (el) el.innerHTML = html;
-            }
-          });
+        MBusMeter& m = meters[mbusCurrentMeter];
+        mbusAccountPoll(mbusStats, 0, now - mbusLastAction);
+        mbusAccountPoll(m.stats, 0, now - mbusLastAction);
+        errorStats.mbusTimeouts++;
+        logError("M-Bus Selektion fehlgeschlagen");
+        if (m.baud != MBUS_BAUD) {
+          // Zähler hat die hohe Rate evtl. selbst verlassen: nächster Zyklus mit 2400
+          m.baud = MBUS_BAUD;
+          m.baudFailures++;
+          saveMeters();
         }
+        mbusNextMeter(now);
       }
-    }
+      break;
 
-    function updateData() {
-      fetch('/api/data')
-        .then(r => r.json())
-        .then(data => {
-          const el = (id) => document.getElementById(id);
-          
-          // AP-Modus Warnung anzeigen
-          if (data.apMode && el('apModeWarning')) {
-            el('apModeWarning').style.display = 'block';
-          }
-          
-          if (el('gasValue')) {
-            el('gasValue').textContent = data.volume >= 0 ? data.volume.toFixed(2) + ' m³' : '-- m³';
-          }
-          
-          // Energie-Anzeige
-          if (el('energyValue')) {
-            if (data.volume >= 0 && data.calorific > 0) {
-              const energy = (data.volume * data.calorific * data.correction).toFixed(3);
-              el('energyValue').textContent = '⚡ ' + energy + ' kWh';
-            } else {
-              el('energyValue').textContent = '⚡ -- kWh';
-            }
-          }
-          
-          // Brennwert & Zustandszahl anzeigen
-          if (el('calorificDisplay')) {
-            el('calorificDisplay').textContent = data.calorific > 0 ? data.calorific.toFixed(6) : '--';
-          }
-          if (el('correctionDisplay')) {
-            el('correctionDisplay').textContent = data.correction > 0 ? data.correction.toFixed(6) : '--';
-          }
-          
-          const wifiDiv = document.getElementById('wifiStatus');
-          if (wifiDiv) {
-            const valueEl = wifiDiv.querySelector('.value');
-            if (valueEl) {
-              if (data.apMode) {
-                valueEl.textContent = 'AP-Modus (' + data.apSSID + ')';
-                wifiDiv.className = 'status-item';
-                wifiDiv.style.borderLeftColor = '#ff9800';
-              } else {
-                valueEl.textContent = data.wifiConnected ? 'Verbunden' : 'Getrennt';
-                wifiDiv.className = data.wifiConnected ? 'status-item status-online' : 'status-item status-offline';
-              }
-            }
-          }
-          
-          // WiFi Signal Strength
-          const signalDiv = document.getElementById('wifiSignal');
-          if (signalDiv) {
-            const valueEl = signalDiv.querySelector('.value');
-            if (valueEl) {
-              if (data.wifiConnected && !data.apMode) {
-                const rssi = data.wifiRSSI;
-                let quality = 'Schlecht';
-                let color = '#dc3545';
-                let bars = '';
-                
-                if (rssi >= -50) {
-                  quality = 'Ausgezeichnet';
-                  color = '#28a745';
-                  bars = '';
-                } else if (rssi >= -60) {
-                  quality = 'Gut';
-                  color = '#28a745';
-                  bars = '';
-                } else if (rssi >= -70) {
-                  quality = 'Mittel';
-                  color = '#ffc107';
-                  bars = '';
-                } else if (rssi >= -80) {
-                  quality = 'Schwach';
-                  color = '#ff9800';
-                  bars = '';
-                }
-                
-                valueEl.textContent = bars + ' ' + rssi + ' dBm (' + quality + ')';
-                signalDiv.style.borderLeftColor = color;
-              } else {
-                valueEl.textContent = '--';
-                signalDiv.style.borderLeftColor = '#667eea';
-              }
-            }
-          }
-          
-          const mqttDiv = document.getElementById('mqttStatus');
-          if (mqttDiv) {
-            const valueEl = mqttDiv.querySelector('.value');
-            if (valueEl) {
-              valueEl.textContent = data.mqttConnected ? 'Verbunden' : 'Getrennt';
-              mqttDiv.className = data.mqttConnected ? 'status-item status-online' : 'status-item status-offline';
-            }
-          }
-          
-          if (el('uptime')) el('uptime').textContent = formatUptime(data.uptime);
-          
-          // Zeitstempel-Anzeige (NTP oder relative Zeit)
-          if (el('lastUpdate')) {
-            if (data.timeInitialized && data.lastUpdate > 1000000000) {
-              const date = new Date(data.lastUpdate * 1000);
-              el('lastUpdate').textContent = date.toLocaleTimeString('de-DE');
-            } else {
-              el('lastUpdate').textContent = 
-                data.lastUpdate > 0 ? Math.floor((data.uptime - data.lastUpdate) / 1000) + 's' : '--';
-            }
-          }
-          
-          if (el('pollInterval')) el('pollInterval').textContent = data.pollInterval + 's';
-          
-          // IP-Adresse in Update-Seite eintragen
-          const ipAddress = data.ipAddress || window.location.hostname || '10.10.40.109';
-          const ipElements = ['currentIP', 'currentIP2', 'currentIP3'];
-          ipElements.forEach(id => {
-            const el = document.getElementById(id);
-            if (el) el.textContent = ipAddress;
-          });
-          
-          // System Info
-          if (data.system) {
-            const el = (id) => document.getElementById(id);
-            if (el('freeHeap')) el('freeHeap').textContent = (data.system.freeHeap / 1024).toFixed(1) + ' KB';
-            if (el('heapSize')) el('heapSize').textContent = (data.system.heapSize / 1024).toFixed(1) + ' KB';
-            if (el('flashSize')) el('flashSize').textContent = (data.system.flashSize / 1024 / 1024).toFixed(1) + ' MB';
-            if (el('sketchSize')) el('sketchSize').textContent = (data.system.sketchSize / 1024).toFixed(1) + ' KB';
-            if (el('freeFlash')) el('freeFlash').textContent = (data.system.freeSketch / 1024).toFixed(1) + ' KB';
-            if (el('chipModel')) el('chipModel').textContent = data.system.chipModel + ' (' + data.system.chipCores + ' Cores @ ' + data.system.cpuFreq + 'MHz)';
-          }
-          
-          // M-Bus Statistiken (von /api/diagnostics)
-          fetch('/api/diagnostics')
-            .then(r => r.json())
-            .then(mbusData => {
-              if (mbusData.mbus) {
-                const successRate = mbusData.mbus.total > 0 ? 
-                  ((mbusData.mbus.successful / mbusData.mbus.total) * 100).toFixed(1) : '0.0';
-                const el = (id) => document.getElementById(id);
-                if (el('mbusSuccessRate')) el('mbusSuccessRate').textContent = successRate + '%';
-                if (el('mbusTotal')) el('mbusTotal').textContent = mbusData.mbus.total;
-                if (el('mbusAvgTime')) el('mbusAvgTime').textContent = 
-                  mbusData.mbus.avgResponseTime > 0 ? mbusData.mbus.avgResponseTime + ' ms' : '-- ms';
-                if (el('mbusLastTime')) el('mbusLastTime').textContent = 
-                  mbusData.mbus.lastResponseTime > 0 ? mbusData.mbus.lastResponseTime + ' ms' : '-- ms';
-              }
-            })
-            .catch(e => console.log('M-Bus Stats nicht verfügbar'));
-          
-          // Error Stats
-          if (data.errors) {
-            const el = (id) => document.getElementById(id);
-            if (el('errMbusTimeout')) el('errMbusTimeout').textContent = data.errors.mbusTimeouts || 0;
-            if (el('errMbusParse')) el('errMbusParse').textContent = data.errors.mbusParseErrors || 0;
-            if (el('errMqtt')) el('errMqtt').textContent = data.errors.mqttErrors || 0;
-            if (el('errWifi')) el('errWifi').textContent = data.errors.wifiDisconnects || 0;
-          }
-          
-          // Letzter Fehler nur anzeigen wenn:
-          // 1. Es einen Fehler gibt UND
-          // 2. Der Fehler nicht älter als 2 Minuten ist UND
-          // 3. System aktuell NICHT verbunden ist (sonst ist Fehler behoben)
-          if (data.errors) {
-            const totalErrors = (data.errors.mbusTimeouts || 0) + (data.errors.mbusParseErrors || 0) + 
-                               (data.errors.mqttErrors || 0) + (data.errors.wifiDisconnects || 0);
-            const errorAge = data.uptime - (data.errors.lastErrorTime || 0);
-            const twoMinutes = 2 * 60 * 1000;
-            const hasActiveIssue = !data.wifiConnected || !data.mqttConnected;
-            
-            const lastErrorEl = document.getElementById('lastError');
-            if (lastErrorEl) {
-              if (data.errors.lastError && totalErrors > 0 && errorAge < twoMinutes && hasActiveIssue) {
-                lastErrorEl.style.display = 'block';
-                const ageText = errorAge < 60000 ? 
-                  'vor ' + Math.floor(errorAge / 1000) + 's' : 
-                  'vor ' + Math.floor(errorAge / 60000) + 'min';
-                const lastErrorMsg = document.getElementById('lastErrorMsg');
-                if (lastErrorMsg) lastErrorMsg.textContent = data.errors.lastError + ' (' + ageText + ')';
-              } else {
-                lastErrorEl.style.display = 'none';
-              }
-            }
-          }
-          
-          if (data.history && data.history.length > 0) {
-            // Normalize timestamps: some stored timestamps may be in ms (old devices)
-            // JS expects seconds. Detect and convert if needed.
-            const nowMs = Date.now();
-            let hist = data.history.map(p => ({ timestamp: p.timestamp, volume: p.volume }));
-            const seemsMs = hist.some(p => p.timestamp > nowMs + 1000);
-            if (seemsMs) {
-              hist = hist.map(p => ({ timestamp: Math.floor(p.timestamp / 1000), volume: p.volume }));
-            }
-            fullHistoryData = hist;
-            updateConsumptionStats(hist, data.calorific, data.correction);
-            drawChart(filterHistoryByTimeRange(hist));
-          }
-        })
-        .catch(e => {
-          console.error('API Fehler beim Laden der Daten:', e);
-          // Zeige Fehler auf der Seite an
-          const elements = ['wifiStatus', 'mqttStatus', 'gasValue'];
-          elements.forEach(id => {
-            const el = document.getElementById(id);
-            if (el && el.querySelector) {
-              const value = el.querySelector('.value');
-              if (value) value.textContent = 'API Fehler';
-            }
-          });
-        });
-    }
-
-    function updateConsumptionStats(history, calorific, correction) {
-      const el = (id) => document.getElementById(id);
-      
-      if (!history || history.length < 2) {
-        ['statToday', 'statWeek', 'statMonth', 'statAvg'].forEach(id => {
-          if (el(id)) el(id).textContent = '-- m³';
-          if (el(id + 'Kwh')) el(id + 'Kwh').textContent = '-- kWh';
-        });
-        return;
-      }
-      
-      const now = Date.now() / 1000;
-      const startOfToday = new Date();
-      startOfToday.setHours(0, 0, 0, 0);
-      const todayTimestamp = startOfToday.getTime() / 1000;
-      const weekAgo = now - (7 * 24 * 3600);
-      const monthAgo = now - (30 * 24 * 3600);
-      
-      // Finde Messwerte
-      const todayStart = history.find(m => m.timestamp >= todayTimestamp);
-      const weekStart = history.find(m => m.timestamp >= weekAgo);
-      const monthStart = history.find(m => m.timestamp >= monthAgo);
-      const latest = history[history.length - 1];
-      const oldest = history[0];
-      
-      // Berechne Differenzen
-      const todayDiff = todayStart ? latest.volume - todayStart.volume : 0;
-      const weekDiff = weekStart ? latest.volume - weekStart.volume : 0;
-      const monthDiff = monthStart ? latest.volume - monthStart.volume : 0;
-      const totalDiff = latest.volume - oldest.volume;
-      const daysSinceStart = (latest.timestamp - oldest.timestamp) / 86400;
-      const avgPerDay = daysSinceStart > 0 ? totalDiff / daysSinceStart : 0;
-      
-      // Anzeigen mit Null-Checks
-      if (el('statToday')) el('statToday').textContent = todayDiff.toFixed(2) + ' m³';
-      if (el('statTodayKwh')) el('statTodayKwh').textContent = (todayDiff * calorific * correction).toFixed(3) + ' kWh';
-      
-      if (el('statWeek')) el('statWeek').textContent = weekDiff.toFixed(2) + ' m³';
-      if (el('statWeekKwh')) el('statWeekKwh').textContent = (weekDiff * calorific * correction).toFixed(3) + ' kWh';
-      
-      if (el('statMonth')) el('statMonth').textContent = monthDiff.toFixed(2) + ' m³';
-      if (el('statMonthKwh')) el('statMonthKwh').textContent = (monthDiff * calorific * correction).toFixed(3) + ' kWh';
-      
-      if (el('statAvg')) el('statAvg').textContent = avgPerDay.toFixed(3) + ' m³';
-      if (el('statAvgKwh')) el('statAvgKwh').textContent = (avgPerDay * calorific * correction).toFixed(3) + ' kWh';
-    }
-
-    function loadConfig() {
-      fetch('/api/config')
-        .then(r => r.json())
-        .then(data => {
-          const el = (id) => document.getElementById(id);
-          
-          if (el('ssid')) el('ssid').value = data.ssid;
-          if (el('password')) el('password').value = data.password;
-          if (el('hostname')) el('hostname').value = data.hostname || 'ESP32-GasZaehler';
-          if (el('mqtt_server')) el('mqtt_server').value = data.mqtt_server;
-          if (el('mqtt_port')) el('mqtt_port').value = data.mqtt_port;
-          if (el('mqtt_user')) el('mqtt_user').value = data.mqtt_user || '';
-          if (el('mqtt_pass')) el('mqtt_pass').value = data.mqtt_pass || '';
-          if (el('mqtt_topic')) el('mqtt_topic').value = data.mqtt_topic;
-          if (el('poll_interval')) el('poll_interval').value = data.poll_interval;
-          if (el('gas_calorific')) el('gas_calorific').value = (data.gas_calorific || 10.0).toFixed(6);
-          if (el('gas_correction')) el('gas_correction').value = (data.gas_correction || 1.0).toFixed(6);
-          
-          // Static IP Felder
-          const useStaticIp = data.use_static_ip || false;
-          if (el('use_static_ip')) el('use_static_ip').checked = useStaticIp;
-          if (el('static_ip')) el('static_ip').value = data.static_ip || '192.168.1.100';
-          if (el('static_gateway')) el('static_gateway').value = data.static_gateway || '192.168.1.1';
-          if (el('static_subnet')) el('static_subnet').value = data.static_subnet || '255.255.255.0';
-          if (el('static_dns')) el('static_dns').value = data.static_dns || '192.168.1.1';
-          if (el('staticIpFields')) el('staticIpFields').style.display = useStaticIp ? 'block' : 'none';
-          
-          // Event Listener für Static IP Toggle
-          if (el('use_static_ip')) {
-            el('use_static_ip').addEventListener('change', function() {
-              if (el('staticIpFields')) el('staticIpFields').style.display = this.checked ? 'block' : 'none';
-            });
-          }
-        })
-        .catch(e => console.error('Fehler:', e));
-    }
-
-    function refreshLogs() {
-      fetch('/api/logs')
-        .then(r => r.json())
-        .then(data => {
-          const container = document.getElementById('logContainer');
-          if (!data.logs || data.logs.length === 0) {
-            container.innerHTML = '<div style="text-align: center; color: var(--text-muted); padding: 20px;">Keine Logs verfügbar</div>';
-            return;
-          }
-          
-          let html = '';
-          const now = Date.now();
-          
-          // Neueste zuerst
-          for (let i = data.logs.length - 1; i >= 0; i--) {
-            const log = data.logs[i];
-            
-            
-            // Absolute Zeit berechnen (jetzt - uptime + log timestamp)
-            const logDate = new Date(now - (data.uptime - log.timestamp));
-            const timeStr = logDate.toLocaleTimeString('de-DE', {
-              hour: '2-digit',
-              minute: '2-digit',
-              second: '2-digit'
-            });
-            
-            // Farben für verschiedene Log-Typen
-            let icon = '•';
-            let color = 'var(--text-primary)';
-            let category = '';
-            const msg = log.message.toLowerCase();
-            
-            // Fehler & Warnungen
-            if (msg.includes('fehler') || msg.includes('error') || msg.includes('failed')) {
-              color = '#ef4444'; icon = '❌';
-            } else if (msg.includes('warnung') || msg.includes('warning') || msg.includes('timeout')) {
-              color = '#fbbf24'; icon = '⚠';
-            } 
-            // Erfolg
-            else if (msg.includes('verbunden') || msg.includes('success') || msg.includes('ok') || msg.includes('erfolgreich')) {
-              color = '#10b981'; icon = '✓';
-            } 
-            // Kategorien
-            else if (msg.includes('m-bus')) {
-              color = '#8b5cf6'; icon = '📡'; category = 'M-Bus';
-            } else if (msg.includes('mqtt')) {
-              color = '#06b6d4'; icon = '🔗'; category = 'MQTT';
-            } else if (msg.includes('wifi') || msg.includes('wlan')) {
-              color = '#3b82f6'; icon = '📶'; category = 'WiFi';
-            } else if (msg.includes('start') || msg.includes('boot') || msg.includes('setup')) {
-              color = '#3b82f6'; icon = '🚀';
-            }
-            
-            html += `<div style="margin-bottom: 8px; padding: 8px; background: rgba(0,0,0,0.2); border-radius: 6px; border-left: 3px solid ${color};">`;
-            html += `<span style="color: var(--text-secondary); font-weight: 600; font-size: 0.85em;">[${timeStr}]</span> `;
-            
-            html += `<span style="color: ${color}; margin: 0 4px;">${icon}</span>`;
-            if (category) {
-              html += `<span style="color: ${color}; font-weight: 600; font-size: 0.85em; background: rgba(0,0,0,0.3); padding: 2px 6px; border-radius: 3px; margin-right: 6px;">${category}</span>`;
-            }
-            html += `<span style="color: ${color};">${log.message}</span>`;
-            html += '</div>';
-          }
-          container.innerHTML = html;
-          
-          // Auto-scroll nach unten wenn ntig
-          if (container.scrollHeight - container.scrollTop < container.clientHeight + 100) {
-            container.scrollTop = container.scrollHeight;
-          }
-        })
-        .catch(e => console.error('Fehler:', e));
-    }
-
-    function scanWifi() {
-      const btn = event.target;
-      const originalText = btn.textContent;
-      btn.textContent = 'Scanne...';
-      btn.disabled = true;
-      
-      fetch('/api/wifi/scan')
-        .then(r => r.json())
-        .then(data => {
-          const select = document.getElementById('wifiList');
-          select.innerHTML = '<option value="">-- Netzwerk auswhlen --</option>';
-          
-          data.networks.forEach(net => {
-            const option = document.createElement('option');
-            const signal = net.rssi > -50 ? '' : net.rssi > -70 ? '' : '';
-            const lock = net.encryption ? '' : '';
-            option.value = net.ssid;
-            option.textContent = `${net.ssid} ${signal} ${lock} (${net.rssi}dBm)`;
-            select.appendChild(option);
-          });
-          
-          select.style.display = 'block';
-          btn.textContent = originalText;
-          btn.disabled = false;
-        })
-        .catch(e => {
-          console.error('Fehler:', e);
-          alert('WiFi-Scan fehlgeschlagen!');
-          btn.textContent = originalText;
-          btn.disabled = false;
-        });
-    }
-
-    function selectWifi() {
-      const select = document.getElementById('wifiList');
-      const ssidInput = document.getElementById('ssid');
-      if (select.value) {
-        ssidInput.value = select.value;
+    case MBUS_WAIT_BAUD_ACK:
+      if (!mbusReceive(now, MBUS_SCAN_TIMEOUT)) break;
+      if (mbusRx.status() == MBUS_RX_COMPLETE) {
+        // Der Zähler wechselt nach seinem ACK; Abfrage mit neuer Rate dient als Prüfung.
+        // Kurzes Blockieren ist hier unkritisch, es trifft nur den M-Bus Task.
+        vTaskDelay(pdMS_TO_TICKS(MBUS_BAUD_SETTLE));
+        mbusSetBaud(mbus_baud);
+        mbusBaudVerify = true;
+        mbusFcb = !mbusFcb;
+      } else {
+        meters[mbusCurrentMeter].baudFailures++;
+        addLog("M-Bus: Baudratenwechsel nicht bestaetigt");
       }
-    }
+      mbusRequestData(millis());
+      break;
 
-    function saveConfig(event) {
-      event.preventDefault();
-      const formData = new FormData(event.target);
-      const config = {
-        ssid: formData.get('ssid'),
-        password: formData.get('password'),
-        hostname: formData.get('hostname'),
-        mqtt_server: formData.get('mqtt_server'),
-        mqtt_port: parseInt(formData.get('mqtt_port')),
-        mqtt_user: formData.get('mqtt_user'),
-        mqtt_pass: formData.get('mqtt_pass'),
-        mqtt_topic: formData.get('mqtt_topic'),
-        // Ensure we send a valid integer: prefer parsed FormData, fallback to element value, then default 30
-        poll_interval: (function(){
-          const v = parseInt(formData.get('poll_interval'));
-          if (!isNaN(v) && v > 0) return v;
-          const el = document.getElementById('poll_interval');
-          const ev = el ? parseInt(el.value) : NaN;
-          if (!isNaN(ev) && ev > 0) return ev;
-          return 30;
-        })(),
-        gas_calorific: parseFloat(formData.get('gas_calorific')),
-        gas_correction: parseFloat(formData.get('gas_correction')),
-        use_static_ip: document.getElementById('use_static_ip').checked,
-        static_ip: formData.get('static_ip'),
-        static_gateway: formData.get('static_gateway'),
-        static_subnet: formData.get('static_subnet'),
-        static_dns: formData.get('static_dns')
-      };
-      
-      fetch('/api/config', {
-        method: 'POST',
-        headers: { 'Content-Type': 'application/json' },
-        body: JSON.stringify(config)
-      })
-      .then(r => r.json())
-      .then(data => {
-        const alert = document.getElementById('configAlert');
-        alert.textContent = 'Einstellungen gespeichert! ESP32 startet neu...';
-        alert.className = 'alert success';
-        alert.style.display = 'block';
-        setTimeout(() => { location.reload(); }, 3000);
-      })
-      .catch(e => {
-        const alert = document.getElementById('configAlert');
-        alert.textContent = 'Fehler beim Speichern!';
-        alert.className = 'alert error';
-        alert.style.display = 'block';
-      });
-    }
-
-    function setTimeRange(hours) {
-      timeRangeHours = hours;
-      
-      // Update button styles
-      document.querySelectorAll('[id^="btn"]').forEach(btn => {
-        btn.style.background = 'white';
-        btn.style.color = '#667eea';
-      });
-      
-      if (hours === 24) document.getElementById('btn24h').style.background = '#667eea';
-      else if (hours === 168) document.getElementById('btn7d').style.background = '#667eea';
-      else if (hours === 720) document.getElementById('btn30d').style.background = '#667eea';
-      else document.getElementById('btnAll').style.background = '#667eea';
-      
-      document.querySelectorAll('[id^="btn"]').forEach(btn => {
-        if (btn.style.background === 'rgb(102, 126, 234)' || btn.style.background === '#667eea') {
-          btn.style.color = 'white';
-        }
-      });
-      
-      const filteredData = filterHistoryByTimeRange(fullHistoryData);
-      drawChart(filteredData);
-      
-      // Update statistics based on filtered time range
-      fetch('/api/data').then(r => r.json()).then(data => {
-        updateConsumptionStats(filteredData, data.calorific, data.correction);
-      }).catch(e => console.error('Fehler beim Laden der Konfiguration:', e));
-    }
-    
-    function filterHistoryByTimeRange(history) {
-      if (!history || history.length === 0) return history;
-      if (timeRangeHours === 0) return history; // Alle anzeigen
-      
-      const now = Date.now() / 1000;
-      const cutoff = now - (timeRangeHours * 3600);
-      
-      return history.filter(point => point.timestamp >= cutoff);
+    case MBUS_WAIT_BAUD_FALLBACK: {
+      if (!mbusReceive(now, MBUS_SCAN_TIMEOUT)) break;
+      MBusMeter& m = meters[mbusCurrentMeter];
+      if (mbusRx.status() == MBUS_RX_COMPLETE) mbusFcb = !mbusFcb;
+      vTaskDelay(pdMS_TO_TICKS(MBUS_BAUD_SETTLE));
+      m.baud = MBUS_BAUD;
+      m.lastByteHist.reset();
+      saveMeters();
+      mbusStartMeter(millis()); // Abfrage mit 2400 Baud wiederholen
+      break;
     }
 
-    function formatUptime(ms) {
-      const s = Math.floor(ms / 1000);
-      const m = Math.floor(s / 60);
-      const h = Math.floor(m / 60);
-      const d = Math.floor(h / 24);
-      if (d > 0) return d + 'd ' + (h % 24) + 'h';
-      if (h > 0) return h + 'h ' + (m % 60) + 'm';
-      return m + 'm ' + (s % 60) + 's';
-    }
+    case MBUS_RETRY_WAIT:
+      if (now - mbusLastAction < mbusRetryDelay) break;
+      mbusRequestData(now);
+      break;
 
-    let myChart = null;
-    
-    function drawChart(history) {
-      if (!history || history.length === 0) {
-        const canvas = document.getElementById('chart');
-        const ctx = canvas.getContext('2d');
-        ctx.clearRect(0, 0, canvas.width, canvas.height);
-        ctx.fillStyle = '#999';
-        ctx.font = '16px sans-serif';
-        ctx.textAlign = 'center';
-        ctx.fillText('Keine Daten für diesen Zeitraum', canvas.width / 2, canvas.height / 2);
-        if (myChart) {
-          myChart.destroy();
-          myChart = null;
-        }
-        return;
-      }
-      
-      if (history.length < 2) return;
-      
-      // Daten für Chart.js aufbereiten
-      const chartData = history.map(point => ({
-        x: point.timestamp * 1000, // Chart.js benötigt Millisekunden
-        y: point.volume
-      }));
-      
-      // Zeitachse-Einheit basierend auf Zeitrange
-      let timeUnit = 'hour';
-      let displayFormats = {hour: 'HH:mm'};
-      let tooltipFormat = 'dd.MM HH:mm';
-      
-      if (timeRangeHours === 0 || timeRangeHours > 720) {
-        timeUnit = 'month';
-        displayFormats = {month: 'MMM yyyy'};
-        tooltipFormat = 'MMM yyyy';
-      } else if (timeRangeHours > 168) {
-        timeUnit = 'day';
-        displayFormats = {day: 'dd.MM'};
-        tooltipFormat = 'dd.MM.yyyy';
-      } else if (timeRangeHours > 24) {
-        timeUnit = 'day';
-        displayFormats = {day: 'dd.MM HH:mm'};
-        tooltipFormat = 'dd.MM HH:mm';
-      }
-      
-      // Altes Chart zerstören
-      if (myChart) {
-        myChart.destroy();
+    case MBUS_WAIT_RESPONSE: {
+      // Zyklus endet mit dem Stopzeichen (L-Feld), nach einer Pause im Bytestrom
+      // oder wenn innerhalb des gelernten Timeouts kein Startzeichen kommt.
+      MBusMeter& m = meters[mbusCurrentMeter];
+      if (!mbusReceive(now, mbusResponseTimeout(m))) break;
+      if (mbusLen > 0) {
+        // Auch defekte Telegramme mitschneiden, gerade die interessieren bei Feldproblemen
+        xSemaphoreTake(captureMutex, portMAX_DELAY);
+        mbusCapture.add(timeInitialized ? time(nullptr) : 0, millis(), mbusCurrentMeter, mbusRx.status(), mbusBuffer, mbusLen);
+        xSemaphoreGive(captureMutex);
       }
-      
-      const ctx = document.getElementById('chart').getContext('2d');
-      myChart = new Chart(ctx, {
-        type: 'line',
-        data: {
-          datasets: [{
-            label: 'Gasverbrauch (m³)',
-            data: chartData,
-            borderColor: '#667eea',
-            backgroundColor: 'rgba(102, 126, 234, 0.1)',
-            borderWidth: 3,
-            pointRadius: 4,
-            pointHoverRadius: 6,
-            pointBackgroundColor: '#667eea',
-            pointBorderColor: '#fff',
-            pointBorderWidth: 2,
-            tension: 0.4,
-            fill: true
-          }]
-        },
-        options: {
-          responsive: true,
-          maintainAspectRatio: false,
-          interaction: {
-            mode: 'nearest',
-            axis: 'x',
-            intersect: false
-          },
-          plugins: {
-            legend: {
-              display: true,
-              labels: {
-                color: '#666',
-                font: {size: 14}
-              }
-            },
-            tooltip: {
-              callbacks: {
-                title: function(context) {
-                  const date = new Date(context[0].parsed.x);
-                  return date.toLocaleString('de-DE', {
-                    day: '2-digit',
-                    month: '2-digit',
-                    year: 'numeric',
-                    hour: '2-digit',
-                    minute: '2-digit'
-                  });
-                },
-                label: function(context) {
-                  return ' ' + context.parsed.y.toFixed(2) + ' m³';
-                }
-              }
-            }
-          },
-          scales: {
-            x: {
-              type: 'time',
-              time: {
-                unit: timeUnit,
-                displayFormats: displayFormats,
-                tooltipFormat: tooltipFormat
-              },
-              grid: {
-                color: 'rgba(0, 0, 0, 0.05)'
-              },
-              ticks: {
-                color: '#666',
-                maxRotation: 45,
-                minRotation: 0
-              }
-            },
-            y: {
-              beginAtZero: false,
-              grid: {
-                color: 'rgba(0, 0, 0, 0.05)'
-              },
-              ticks: {
-                color: '#666',
-                callback: function(value) {
-                  return value.toFixed(2) + ' m³';
-                }
-              }
-            }
-          }
+      MBusFrame frame;
+      bool valid = mbusRx.status() == MBUS_RX_COMPLETE && mbusParseLongFrame(mbusBuffer, mbusLen, frame) == MBUS_DECODE_OK;
+      if (!valid) {
+        // Bei der Baudratenprüfung nicht wiederholen, dort ist die Rate das Problem
+        if (!mbusBaudVerify && mbusRetryAllowed(m, now)) {
+          mbusScheduleRetry(now);
+          break;
+        }
+        if (mbusCurrentBaud != MBUS_BAUD) {
+          mbusBaudFallback(now);
+          break;
+        }
+      } else {
+        m.firstByteHist.add(mbusRx.frameStartMs() - mbusLastAction);
+        m.lastByteHist.add(mbusRx.lastByteMs() - mbusLastAction);
+        mbusLatency.firstByte.add(mbusRx.frameStartMs() - mbusLastAction);
+        mbusLatency.transfer.add(mbusRx.lastByteMs() - mbusRx.frameStartMs());
+        if (mbusBaudVerify) {
+          m.baud = mbusCurrentBaud;
+          m.baudFailures = 0;
+          mbusBaudVerify = false;
+          m.lastByteHist.reset(); // Telegrammdauer hängt an der Baudrate
+          saveMeters();
+          addLog("M-Bus: " + String(m.baud) + " Baud bestaetigt (Adresse " + String(m.address) + ")");
         }
-      });
-    }
-    
-    // Chart.js kümmert sich um Tooltips
-    document.addEventListener('DOMContentLoaded', function() {
-        chartZoom *= delta;
-        chartZoom = Math.max(0.5, Math.min(3, chartZoom));
-        drawChart(filterHistoryByTimeRange(fullHistoryData));
-    });
-
-    // Diagnose-Funktionen
-    function testMQTT() {
-      const result = document.getElementById('diagResult');
-      result.style.display = 'block';
-      result.style.color = 'var(--text-secondary)';
-      result.innerHTML = '<span style="color: var(--accent-color);">⏳</span> Teste MQTT-Verbindung...';
-      
-      fetch('/api/test/mqtt')
-        .then(r => r.json())
-        .then(data => {
-          const status = data.connected ? '<span style="color: #10b981;">✓ Verbunden</span>' : '<span style="color: #ef4444;">✗ Getrennt</span>';
-          result.innerHTML = `<div style="color: var(--text-primary); line-height: 1.8;">
-            <strong style="color: var(--accent-color); font-size: 1.1em;">📡 MQTT Test</strong><br><br>
-            <span style="color: var(--text-secondary);">Server:</span> <code style="color: var(--accent-color);">${data.server}:${data.port}</code><br>
-            <span style="color: var(--text-secondary);">Status:</span> ${status}<br>
-            <span style="color: var(--text-secondary);">Last Will:</span> <code>${data.availability_topic}</code><br>
-            <span style="color: var(--text-secondary);">Antwortzeit:</span> <strong style="color: #10b981;">${data.response_time}</strong>
-          </div>`;
-        })
-        .catch(e => {
-          result.innerHTML = '<span style="color: #ef4444;">❌ MQTT Test fehlgeschlagen: ' + e + '</span>';
-        });
-    }
-
-    function testWiFi() {
-      const result = document.getElementById('diagResult');
-      result.style.display = 'block';
-      result.style.color = 'var(--text-secondary)';
-      result.innerHTML = '<span style="color: var(--accent-color);">⏳</span> Prüfe WiFi-Verbindung...';
-      
-      fetch('/api/test/wifi')
-        .then(r => r.json())
-        .then(data => {
-          let quality = 'Schlecht';
-          let qualityColor = '#ef4444';
-          if (data.rssi >= -50) { quality = 'Ausgezeichnet'; qualityColor = '#10b981'; }
-          else if (data.rssi >= -60) { quality = 'Gut'; qualityColor = '#10b981'; }
-          else if (data.rssi >= -70) { quality = 'Mittel'; qualityColor = '#fbbf24'; }
-          
-          result.innerHTML = `<div style="color: var(--text-primary); line-height: 1.8;">
-            <strong style="color: var(--accent-color); font-size: 1.1em;">📶 WiFi Status</strong><br><br>
-            <span style="color: var(--text-secondary);">SSID:</span> <code style="color: var(--accent-color);">${data.ssid}</code><br>
-            <span style="color: var(--text-secondary);">Signal:</span> <strong style="color: ${qualityColor};">${data.rssi} dBm (${quality})</strong><br>
-            <span style="color: var(--text-secondary);">Kanal:</span> ${data.channel}<br>
-            <span style="color: var(--text-secondary);">IP:</span> <code style="color: #10b981; font-weight: bold;">${data.ip}</code><br>
-            <span style="color: var(--text-secondary);">MAC:</span> <code>${data.mac}</code><br>
-            <span style="color: var(--text-secondary);">Hostname:</span> <code>${data.hostname}</code>
-          </div>`;
-        })
-        .catch(e => {
-          result.innerHTML = '<span style="color: #ef4444;">❌ WiFi Test fehlgeschlagen: ' + e + '</span>';
-        });
-    }
-
-    function pingGateway() {
-      const result = document.getElementById('diagResult');
-      result.style.display = 'block';
-      result.style.color = 'var(--text-secondary)';
-      result.innerHTML = '<span style="color: var(--accent-color);">⏳</span> Pinge Gateway...';
-      
-      fetch('/api/test/ping')
-        .then(r => r.json())
-        .then(data => {
-          const reachable = data.reachable ? '<span style="color: #10b981;">✓ Ja</span>' : '<span style="color: #ef4444;">✗ Nein</span>';
-          result.innerHTML = `<div style="color: var(--text-primary); line-height: 1.8;">
-            <strong style="color: var(--accent-color); font-size: 1.1em;">🌐 Gateway Ping</strong><br><br>
-            <span style="color: var(--text-secondary);">Gateway:</span> <code style="color: var(--accent-color); font-weight: bold;">${data.gateway}</code><br>
-            <span style="color: var(--text-secondary);">Erreichbar:</span> ${reachable}<br>
-            <span style="color: var(--text-secondary);">Antwortzeit:</span> <strong style="color: #10b981;">${data.response_time}</strong><br>
-            <span style="color: var(--text-secondary);">DNS:</span> <code>${data.dns}</code>
-          </div>`;
-        })
-        .catch(e => {
-          result.innerHTML = '<span style="color: #ef4444;">❌ Ping fehlgeschlagen: ' + e + '</span>';
-        });
-    }
-
-    function refreshMBusData() {
-      // Trigger M-Bus Poll
-      fetch('/api/mbus/trigger', { method: 'POST' })
-        .then(r => r.json())
-        .then(data => {
-          console.log('M-Bus Trigger:', data.message);
-          // Warte 2 Sekunden und lade dann Stats
-          setTimeout(() => {
-            fetch('/api/mbus/stats')
-              .then(r => r.json())
-              .then(stats => {
-                const rate = stats.total > 0 ? ((stats.successful / stats.total) * 100).toFixed(1) : 0;
-                const avgTime = stats.total > 0 ? (stats.total_time / stats.total).toFixed(0) : 0;
-                
-                const el = (id) => document.getElementById(id);
-                if (el('mbusSuccessRate')) el('mbusSuccessRate').textContent = rate + '%';
-                if (el('mbusAvgResponse')) el('mbusAvgResponse').textContent = avgTime + ' ms';
-                if (el('mbusLastResponse')) el('mbusLastResponse').textContent = stats.last_response + ' ms';
-                if (el('mbusTotalPolls')) el('mbusTotalPolls').textContent = stats.total;
-                if (el('mbusHexDump')) el('mbusHexDump').textContent = stats.hex_dump || 'Keine Daten';
-              })
-              .catch(e => console.error('Stats Fehler:', e));
-          }, 2000);
-        })
-        .catch(e => console.error('Trigger Fehler:', e));
-    }
-
-    function resetErrorStats() {
-      if (confirm('Möchten Sie die Fehlerstatistik wirklich zurücksetzen?')) {
-        fetch('/api/errors/reset', { method: 'POST' })
-          .then(r => r.json())
-          .then(data => {
-            console.log('Fehlerstatistik zurückgesetzt');
-            // UI sofort aktualisieren
-            document.getElementById('errMbusTimeout').textContent = '0';
-            document.getElementById('errMbusParse').textContent = '0';
-            document.getElementById('errMqtt').textContent = '0';
-            document.getElementById('errWifi').textContent = '0';
-            document.getElementById('lastError').style.display = 'none';
-            alert('✅ Fehlerstatistik wurde zurückgesetzt!');
-          })
-          .catch(e => {
-            console.error('Reset Fehler:', e);
-            alert('❌ Fehler beim Zurücksetzen!');
-          });
       }
+      mbusRetries = 0;
+      if (mbusHandleResponse(now)) break; // Folgetelegramm angefordert
+      mbusNextMeter(now);
+      break;
     }
+  }
+}
 
-    function exportData() {
-      fetch('/api/data')
-        .then(r => r.json())
-        .then(data => {
-          if (!data.history || data.history.length === 0) {
-            alert('Keine Daten zum Exportieren vorhanden!');
-            return;
-          }
-          
-          let csv = 'Timestamp,Unix Time,Volume (m),Energy (kWh)\n';
-          data.history.forEach(point => {
-            const date = new Date(point.timestamp * 1000);
-            const dateStr = date.toISOString();
-            const energy = (point.volume * data.calorific * data.correction).toFixed(1);
-            csv += `${dateStr},${point.timestamp},${point.volume.toFixed(2)},${energy}\n`;
-          });
-          
-          const blob = new Blob([csv], { type: 'text/csv' });
-          const url = window.URL.createObjectURL(blob);
-          const a = document.createElement('a');
-          a.href = url;
-          a.download = 'gaszaehler_export_' + new Date().toISOString().split('T')[0] + '.csv';
-          a.click();
-          window.URL.revokeObjectURL(url);
-          
-          const result = document.getElementById('diagResult');
-          result.style.display = 'block';
-          result.textContent = ` CSV Export erfolgreich!\n\n${data.history.length} Datenpunkte exportiert\nDatei: ${a.download}`;
-          result.style.color = '#28a745';
-        })
-        .catch(e => {
-          alert('Export fehlgeschlagen: ' + e);
-        });
-    }
-
-    // Dark Mode initialisieren
-    initDarkMode();
-    
-    updateData();
-    updateInterval = setInterval(updateData, 5000);
-  </script>
-</body>
-</html>
-)rawliteral";
+void mbusTask(void* param) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    mbusProcess(millis());
+    vTaskDelayUntil(&lastWake, MBUS_TASK_PERIOD);
+  }
+}
+
+// ---- OTA Setup ----
+void setupOTA() {
+  ArduinoOTA.setHostname("esp32-gas");
+  ArduinoOTA.onStart([]() { Serial.println("Start OTA Update"); });
+  ArduinoOTA.onEnd([]() { Serial.println("\nOTA Ende"); });
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+    Serial.printf("Fortschritt: %u%%\r", (progress / (total / 100)));
+  });
+  ArduinoOTA.onError([](ota_error_t error) {
+    Serial.printf("OTA Fehler[%u]: ", error);
+    if (error == OTA_AUTH_ERROR) Serial.println("Auth fehlgeschlagen");
+    else if (error == OTA_BEGIN_ERROR) Serial.println("Begin fehlgeschlagen");
+    else if (error == OTA_CONNECT_ERROR) Serial.println("Verbindung fehlgeschlagen");
+    else if (error == OTA_RECEIVE_ERROR) Serial.println("Empfang fehlgeschlagen");
+    else if (error == OTA_END_ERROR) Serial.println("End fehlgeschlagen");
+  });
+  ArduinoOTA.begin();
+  Serial.println("OTA bereit");
+}
+
+// ---- WebServer Handler ----
 
 void handleRoot() {
-  // HTML direkt aus Flash senden (PROGMEM)
-  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
-  server.send(200, "text/html", "");
-  
-  // In Chunks senden um Speicherprobleme zu vermeiden
-  const size_t chunkSize = 1024;
-  size_t len = strlen_P(htmlPage);
-  char buffer[chunkSize + 1];
-  
-  for (size_t i = 0; i < len; i += chunkSize) {
-    size_t remaining = len - i;
-    size_t sendSize = (remaining < chunkSize) ? remaining : chunkSize;
-    
-    // Aus PROGMEM in Buffer kopieren
-    memcpy_P(buffer, htmlPage + i, sendSize);
-    buffer[sendSize] = '\0';
-    
-    server.sendContent(buffer);
-    yield(); // ESP32 Watchdog zurücksetzen
+  // Web-UI liegt minifiziert und gzip-komprimiert im Flash (scripts/build_web.py).
+  // Der Browser fragt bei jedem Aufruf mit If-None-Match nach; solange die
+  // Firmware gleich bleibt, genügt ein 304 ohne Inhalt.
+  server.sendHeader("ETag", WEB_UI_ETAG);
+  server.sendHeader("Cache-Control", "no-cache");
+  if (server.header("If-None-Match") == WEB_UI_ETAG) {
+    server.send(304);
+    return;
   }
-  
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, "text/html", (const char*)WEB_UI_GZ, WEB_UI_GZ_LEN);
+}
+
+// ---- JSON-Antworten ----
+// Antworten werden mit JsonWriter direkt in jsonChunk geschrieben und blockweise
+// als Chunked-Transfer verschickt; der Heap-Bedarf pro Anfrage bleibt unabhängig
+// von Verlauf und Log-Länge. Die Handler laufen nacheinander in loop(), ein
+// gemeinsamer Puffer genügt.
+const size_t JSON_CHUNK_SIZE = 1024;
+char jsonChunk[JSON_CHUNK_SIZE];
+
+void jsonSendChunk(void* ctx, const char* data, size_t len) {
+  server.sendContent(data, len);
+}
+
+JsonWriter jsonBegin(int code = 200) {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(code, "application/json", "");
+  return JsonWriter(jsonChunk, sizeof(jsonChunk), jsonSendChunk, NULL);
+}
+
+void jsonEnd(JsonWriter& w) {
+  w.flush();
   server.sendContent("");
-  server.client().stop();
 }
 
-void handleAPI() {
-  String json = "{";
-  json += "\"volume\":" + String(lastVolume, 2) + ",";
-  json += "\"wifiConnected\":" + String(WiFi.status() == WL_CONNECTED ? "true" : "false") + ",";
-  json += "\"wifiRSSI\":" + String(WiFi.RSSI()) + ",";
-  json += "\"mqttConnected\":" + String(client.connected() ? "true" : "false") + ",";
-  json += "\"apMode\":" + String(apMode ? "true" : "false") + ",";
-  json += "\"apSSID\":\"" + String(ap_ssid) + "\",";
-  json += "\"ipAddress\":\"" + (apMode ? WiFi.softAPIP().toString() : WiFi.localIP().toString()) + "\",";
-  json += "\"uptime\":" + String(millis()) + ",";
-  json += "\"lastUpdate\":" + String(measurements.empty() ? 0 : measurements.back().timestamp) + ",";
-  json += "\"timeInitialized\":" + String(timeInitialized ? "true" : "false") + ",";
-  json += "\"pollInterval\":" + String(poll_interval / 1000) + ",";
+void jsonIpField(JsonWriter& w, const char* key, const IPAddress& ip) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  w.field(key, buf);
+}
+
+// Aktueller Zustand für Dashboard (/api/data und SSE "status"), ohne Verlauf
+void apiStatusJson(JsonWriter& w) {
+  w.field("volume", lastVolume, 2);
+  w.field("wifiConnected", WiFi.status() == WL_CONNECTED);
+  w.field("wifiRSSI", WiFi.RSSI());
+  w.field("mqttConnected", mqttConnected());
+  w.field("apMode", apMode);
+  w.field("apSSID", ap_ssid);
+  jsonIpField(w, "ipAddress", apMode ? WiFi.softAPIP() : WiFi.localIP());
+  w.field("uptime", millis());
+  w.field("lastUpdate", measurements.empty() ? 0UL : measurements.back().timestamp);
+  w.field("timeInitialized", timeInitialized);
+  w.field("pollInterval", poll_interval / 1000);
   // backward-compatible key expected by the WebUI
-  json += "\"poll_interval\":" + String(poll_interval / 1000) + ",";
-  json += "\"calorific\":" + String(gas_calorific_value, 6) + ",";
-  json += "\"correction\":" + String(gas_correction_factor, 6) + ",";
-  json += "\"system\":{";
-  json += "\"freeHeap\":" + String(ESP.getFreeHeap()) + ",";
-  json += "\"heapSize\":" + String(ESP.getHeapSize()) + ",";
-  json += "\"flashSize\":" + String(ESP.getFlashChipSize()) + ",";
-  json += "\"sketchSize\":" + String(ESP.getSketchSize()) + ",";
-  json += "\"freeSketch\":" + String(ESP.getFreeSketchSpace()) + ",";
-  json += "\"chipModel\":\"" + String(ESP.getChipModel()) + "\",";
-  json += "\"chipCores\":" + String(ESP.getChipCores()) + ",";
-  json += "\"cpuFreq\":" + String(ESP.getCpuFreqMHz());
-  json += "},";
-  json += "\"errors\":{";
-  json += "\"mbusTimeouts\":" + String(errorStats.mbusTimeouts) + ",";
-  json += "\"mbusParseErrors\":" + String(errorStats.mbusParseErrors) + ",";
-  json += "\"mqttErrors\":" + String(errorStats.mqttErrors) + ",";
-  json += "\"wifiDisconnects\":" + String(errorStats.wifiDisconnects) + ",";
-  json += "\"lastError\":\"" + String(errorStats.lastErrorMsg) + "\",";
-  json += "\"lastErrorTime\":" + String(errorStats.lastError);
-  json += "},";
-  json += "\"history\":[";
-  for (size_t i = 0; i < measurements.size(); i++) {
-    if (i > 0) json += ",";
-    json += "{\"timestamp\":" + String(measurements[i].timestamp) + 
-            ",\"volume\":" + String(measurements[i].volume, 2) + "}";
-  }
-  json += "]}";
-  server.send(200, "application/json", json);
+  w.field("poll_interval", poll_interval / 1000);
+  w.field("pollAdaptive", poll_adaptive);
+  w.field("activePollInterval", mbusPollInterval / 1000);
+  w.field("flow", pollScheduler.flowM3h(), 3);
+  w.field("calorific", gas_calorific_value, 6);
+  w.field("correction", gas_correction_factor, 6);
+  w.key("system");
+  w.beginObject();
+  w.field("freeHeap", ESP.getFreeHeap());
+  w.field("heapSize", ESP.getHeapSize());
+  w.field("flashSize", ESP.getFlashChipSize());
+  w.field("sketchSize", ESP.getSketchSize());
+  w.field("freeSketch", ESP.getFreeSketchSpace());
+  w.field("chipModel", ESP.getChipModel());
+  w.field("chipCores", ESP.getChipCores());
+  w.field("cpuFreq", ESP.getCpuFreqMHz());
+  w.endObject();
+  w.key("errors");
+  w.beginObject();
+  w.field("mbusTimeouts", errorStats.mbusTimeouts);
+  w.field("mbusParseErrors", errorStats.mbusParseErrors);
+  w.field("mbusRetries", errorStats.mbusRetries);
+  w.field("mqttErrors", errorStats.mqttErrors);
+  w.field("wifiDisconnects", errorStats.wifiDisconnects);
+  w.field("lastError", errorStats.lastErrorMsg);
+  w.field("lastErrorTime", errorStats.lastError);
+  w.endObject();
+  w.key("mbus");
+  w.beginObject();
+  w.field("total", mbusStats.totalPolls);
+  w.field("successful", mbusStats.successfulPolls);
+  w.field("avgResponseTime", mbusStats.avgResponseTime);
+  w.field("lastResponseTime", mbusStats.lastResponseTime);
+  w.endObject();
+}
+
+void handleAPI() {
+  // Nur der aktuelle Zustand, der Verlauf kommt über /api/history
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  apiStatusJson(w);
+  w.endObject();
+  jsonEnd(w);
+}
+
+// Zahl-Parameter einer Anfrage, fallback wenn nicht gesetzt
+unsigned long queryArg(const char* name, unsigned long fallback) {
+  return server.hasArg(name) ? strtoul(server.arg(name).c_str(), NULL, 10) : fallback;
+}
+
+// Ausgewählter Bereich von measurements als Zeitreihe für lttbSelect
+struct HistorySeries {
+  size_t begin;
+  size_t count;
+  size_t size() const { return count; }
+  unsigned long t(size_t i) const { return measurements[begin + i].timestamp; }
+  double x(size_t i) const { return t(i); }
+  double y(size_t i) const { return measurements[begin + i].volume; }
+};
+
+// Schreibt die gewählten Zeitstempel: erster absolut, danach Differenz zum Vorgänger
+struct HistoryTimestampEmit {
+  JsonWriter& w;
+  const HistorySeries& s;
+  bool first;
+  unsigned long prev;
+  void operator()(size_t i) {
+    unsigned long t = s.t(i);
+    if (first) w.value(t);
+    else w.value((long)(t - prev));
+    first = false;
+    prev = t;
+  }
+};
+
+struct HistoryVolumeEmit {
+  JsonWriter& w;
+  const HistorySeries& s;
+  void operator()(size_t i) { w.value(s.y(i), 2); }
+};
+
+void handleHistory() {
+  // Verlauf spaltenweise: timestamps[0] absolut, danach Differenzen zum Vorgänger,
+  // volumes parallel dazu.
+  //   since   nur Einträge danach (Cursor: "last" der vorigen Antwort)
+  //   from    ab diesem Zeitstempel (inklusive)
+  //   to      bis zu diesem Zeitstempel (inklusive)
+  //   limit   höchstens so viele der neuesten Einträge ("truncated": true)
+  //   points  Auswahl per LTTB auf höchstens so viele Punkte reduzieren (ab 3)
+  unsigned long since = queryArg("since", 0);
+  unsigned long from = queryArg("from", 0);
+  unsigned long to = queryArg("to", ~0UL);
+  size_t limit = queryArg("limit", 0);
+  size_t points = queryArg("points", 0);
+  if (from < HISTORY_MIN_EPOCH) from = HISTORY_MIN_EPOCH; // nur Unix-Zeitstempel
+  
+  // measurements ist zeitlich sortiert: Auswahl ist ein zusammenhängender Bereich
+  size_t begin = 0;
+  size_t end = measurements.size();
+  while (begin < end && (measurements[begin].timestamp <= since || measurements[begin].timestamp < from)) begin++;
+  while (end > begin && measurements[end - 1].timestamp > to) end--;
+  // LTTB und die Differenzen brauchen streng steigende Zeitstempel: springt
+  // die Uhr zurück (NTP-Korrektur), nur den Teil nach dem Rücksprung liefern
+  for (size_t i = end; i > begin + 1; i--) {
+    if (measurements[i - 1].timestamp <= measurements[i - 2].timestamp) {
+      begin = i - 1;
+      break;
+    }
+  }
+  bool truncated = limit > 0 && end - begin > limit;
+  if (truncated) begin = end - limit;
+  
+  HistorySeries series = {begin, end - begin};
+  size_t threshold = points >= 3 ? points : 0; // 0 = alle Punkte
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.field("max", MAX_MEASUREMENTS);
+  w.field("truncated", truncated);
+  w.field("downsampled", threshold > 0 && series.count > threshold);
+  w.field("last", end > begin ? measurements[end - 1].timestamp : since);
+  w.key("timestamps");
+  w.beginArray();
+  HistoryTimestampEmit emitTimestamp = {w, series, true, 0};
+  size_t count = lttbSelect(series, threshold, emitTimestamp);
+  w.endArray();
+  w.key("volumes");
+  w.beginArray();
+  HistoryVolumeEmit emitVolume = {w, series};
+  lttbSelect(series, threshold, emitVolume);
+  w.endArray();
+  w.field("count", count);
+  w.endObject();
+  jsonEnd(w);
 }
 
 void handleConfigGet() {
-  String json = "{";
-  json += "\"ssid\":\"" + String(ssid) + "\",";
-  json += "\"password\":\"" + String(password) + "\",";
-  json += "\"hostname\":\"" + String(hostname) + "\",";
-  json += "\"mqtt_server\":\"" + String(mqtt_server) + "\",";
-  json += "\"mqtt_port\":" + String(mqtt_port) + ",";
-  json += "\"mqtt_user\":\"" + String(mqtt_user) + "\",";
-  json += "\"mqtt_pass\":\"" + String(mqtt_pass) + "\",";
-  json += "\"mqtt_topic\":\"" + String(mqtt_topic) + "\",";
-  json += "\"poll_interval\":" + String(poll_interval / 1000) + ",";
-  json += "\"gas_calorific\":" + String(gas_calorific_value, 6) + ",";
-  json += "\"gas_correction\":" + String(gas_correction_factor, 6);
-  json += "}";
-  server.send(200, "application/json", json);
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.field("ssid", ssid);
+  w.field("password", password);
+  w.field("hostname", hostname);
+  w.field("mqtt_server", mqtt_server);
+  w.field("mqtt_port", mqtt_port);
+  w.field("mqtt_user", mqtt_user);
+  w.field("mqtt_pass", mqtt_pass);
+  w.field("mqtt_topic", mqtt_topic);
+  w.field("mqtt_json", mqtt_json);
+  w.field("ha_device_discovery", ha_device_discovery);
+  w.field("pub_change_only", pub_change_only);
+  w.field("pub_heartbeat", pub_heartbeat / 1000);
+  w.field("pub_volume_db", pub_volume_db, 3);
+  w.field("pub_rssi_db", pub_rssi_db);
+  w.field("pub_rate_db", pub_rate_db, 1);
+  w.field("poll_interval", poll_interval / 1000);
+  w.field("gas_calorific", gas_calorific_value, 6);
+  w.field("gas_correction", gas_correction_factor, 6);
+  w.field("mbus_scan", mbus_scan_enabled);
+  w.field("poll_adaptive", poll_adaptive);
+  w.field("poll_min", poll_min / 1000);
+  w.field("poll_max", poll_max / 1000);
+  w.field("poll_align", poll_align);
+  w.field("mbus_baud", mbus_baud);
+  w.endObject();
+  jsonEnd(w);
 }
 
 void handleLogs() {
-  String json = "{";
-  json += "\"uptime\":" + String(millis()) + ",";
-  json += "\"logs\":[";
-  for (size_t i = 0; i < logBuffer.size(); i++) {
-    if (i > 0) json += ",";
-    json += "{";
-    json += "\"timestamp\":" + String(logBuffer[i].timestamp);
-    json += ",\"message\":\"" + logBuffer[i].message + "\"";
-    json += "}";
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.field("uptime", millis());
+  w.key("logs");
+  w.beginArray();
+  // Mutex nur je Eintrag halten: addLog() aus dem M-Bus Task wartet sonst auf den Client
+  for (size_t i = 0;; i++) {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    if (i >= logBuffer.size()) {
+      xSemaphoreGive(logMutex);
+      break;
+    }
+    w.beginObject();
+    w.field("timestamp", logBuffer[i].timestamp);
+    w.field("message", logBuffer[i].message.c_str());
+    w.endObject();
+    xSemaphoreGive(logMutex);
   }
-  json += "]}";
-  server.send(200, "application/json", json);
+  w.endArray();
+  w.endObject();
+  jsonEnd(w);
+}
+
+void latencyJson(JsonWriter& w, const char* key, const LatencyHistogram& h) {
+  w.key(key);
+  w.beginObject();
+  w.field("n", h.count());
+  w.field("p50", h.percentile(50));
+  w.field("p95", h.percentile(95));
+  w.field("p99", h.percentile(99));
+  w.field("max", h.max());
+  w.endObject();
+}
+
+void mbusLatencyJson(JsonWriter& w) {
+  w.key("latency");
+  w.beginObject();
+  latencyJson(w, "first_byte", mbusLatency.firstByte);
+  latencyJson(w, "transfer", mbusLatency.transfer);
+  latencyJson(w, "decode_us", mbusLatency.decodeUs);
+  latencyJson(w, "publish", mbusLatency.publish);
+  latencyJson(w, "total", mbusLatency.total);
+  w.endObject();
+}
+
+void publishCounterJson(JsonWriter& w, const char* key, const PublishCounter& c) {
+  w.key(key);
+  w.beginObject();
+  w.field("published", c.published);
+  w.field("suppressed", c.suppressed);
+  w.endObject();
 }
 
 void handleDiagnostics() {
-  String json = "{\"mbus\":{";
-  json += "\"total\":" + String(mbusStats.totalPolls) + ",";
-  json += "\"successful\":" + String(mbusStats.successfulPolls) + ",";
-  json += "\"avgResponseTime\":" + String(mbusStats.avgResponseTime) + ",";
-  json += "\"lastResponseTime\":" + String(mbusStats.lastResponseTime);
-  json += "}}";
-  server.send(200, "application/json", json);
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.key("mbus");
+  w.beginObject();
+  w.field("total", mbusStats.totalPolls);
+  w.field("successful", mbusStats.successfulPolls);
+  w.field("avgResponseTime", mbusStats.avgResponseTime);
+  w.field("lastResponseTime", mbusStats.lastResponseTime);
+  w.field("lastFirstByteTime", mbusStats.lastFirstByteTime);
+  w.field("lastWireTime", mbusStats.lastWireTime);
+  w.field("lastBaud", mbusStats.lastBaud);
+  w.field("targetBaud", mbus_baud);
+  w.field("retries", errorStats.mbusRetries);
+  w.key("meters");
+  w.beginArray();
+  for (int i = 0; i < meterCount; i++) {
+    w.beginObject();
+    w.field("address", meters[i].address);
+    w.field("baud", meters[i].baud);
+    w.field("baudFailures", meters[i].baudFailures);
+    w.field("wireTime", meters[i].stats.lastWireTime);
+    w.field("responseTime", meters[i].stats.lastResponseTime);
+    w.field("timeout", mbusResponseTimeout(meters[i]));
+    w.field("firstByteP99", meters[i].firstByteHist.percentile(99));
+    w.field("lastByteP99", meters[i].lastByteHist.percentile(99));
+    w.endObject();
+  }
+  w.endArray();
+  w.field("queued", mbusReadings.size());
+  w.field("queueDropped", mbusReadings.dropped());
+  w.field("taskStackFree", mbusTaskHandle ? uxTaskGetStackHighWaterMark(mbusTaskHandle) : 0);
+  w.endObject();
+  w.key("reads");
+  w.beginObject();
+  w.field("requests", mbusReadStats.requests);
+  w.field("cycles", mbusReadStats.cycles);
+  w.field("coalesced", mbusReadStats.coalesced);
+  w.field("timeouts", mbusReadStats.timeouts);
+  w.field("pending", mbusReadTarget != 0);
+  w.endObject();
+  w.key("schedule");
+  w.beginObject();
+  w.field("aligned", poll_align && timeInitialized);
+  w.field("cycles", mbusSchedule.cycles);
+  w.field("lastJitter", mbusSchedule.lastJitter);
+  w.field("maxJitter", mbusSchedule.maxJitter);
+  w.field("avgJitter", mbusSchedule.cycles ? mbusSchedule.totalJitter / mbusSchedule.cycles : 0);
+  w.endObject();
+  mbusLatencyJson(w);
+  w.key("mqtt");
+  w.beginObject();
+  static const char* const connStateText[] = {"down", "connecting", "connecting", "up"};
+  w.field("state", connStateText[mqttConnState]);
+  w.field("attempts", mqttConn.attempts);
+  w.field("failures", mqttConn.failures);
+  w.field("lastConnectMs", mqttConn.lastConnectMs);
+  w.field("maxConnectMs", mqttConn.maxConnectMs);
+  w.field("backoff", mqttConn.backoffMs);
+  w.endObject();
+  w.key("publish");
+  w.beginObject();
+  w.field("changeOnly", pub_change_only);
+  publishCounterJson(w, "volume", publishStats.volume);
+  publishCounterJson(w, "wifi", publishStats.wifi);
+  publishCounterJson(w, "rate", publishStats.rate);
+  publishCounterJson(w, "state", publishStats.state);
+  w.endObject();
+  w.key("outbox");
+  w.beginObject();
+  w.field("pending", outboxSize());
+  w.field("flashChunks", outboxFlashTail - outboxFlashHead);
+  w.field("queued", outboxStats.queued);
+  w.field("sent", outboxStats.sent);
+  w.field("spilled", outboxStats.spilled);
+  w.field("dropped", outboxStats.dropped);
+  w.endObject();
+  w.endObject();
+  jsonEnd(w);
 }
 
 void handleWifiScan() {
   Serial.println("WiFi-Scan gestartet...");
   int n = WiFi.scanNetworks();
   
-  String json = "{\"networks\":[";
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.key("networks");
+  w.beginArray();
   for (int i = 0; i < n; i++) {
-    if (i > 0) json += ",";
-    json += "{";
-    json += "\"ssid\":\"" + WiFi.SSID(i) + "\"";
-    json += ",\"rssi\":" + String(WiFi.RSSI(i));
-    json += ",\"encryption\":" + String(WiFi.encryptionType(i) != WIFI_AUTH_OPEN ? "true" : "false");
-    json += "}";
+    w.beginObject();
+    w.field("ssid", WiFi.SSID(i).c_str());
+    w.field("rssi", WiFi.RSSI(i));
+    w.field("encryption", WiFi.encryptionType(i) != WIFI_AUTH_OPEN);
+    w.endObject();
   }
-  json += "]}";
+  w.endArray();
+  w.endObject();
+  jsonEnd(w);
   
   WiFi.scanDelete();
-  server.send(200, "application/json", json);
-  Serial.println("WiFi-Scan abgeschlossen: " + String(n) + " Netzwerke gefunden");
+  Serial.printf("WiFi-Scan abgeschlossen: %d Netzwerke gefunden\n", n);
 }
 
 // Diagnose-Endpunkte
 void handleTestMQTT() {
-  unsigned long start = millis();
-  bool connected = client.connected();
-  unsigned long responseTime = millis() - start;
-  
-  String json = "{";
-  json += "\"server\":\"" + String(mqtt_server) + "\",";
-  json += "\"port\":" + String(mqtt_port) + ",";
-  json += "\"connected\":" + String(connected ? "true" : "false") + ",";
-  json += "\"availability_topic\":\"" + String(mqtt_availability_topic) + "\",";
-  json += "\"response_time\":" + String(responseTime);
-  json += "}";
-  server.send(200, "application/json", json);
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.field("server", mqtt_server);
+  w.field("port", mqtt_port);
+  w.field("connected", mqttConnected());
+  w.field("availability_topic", mqtt_availability_topic);
+  w.field("response_time", mqttConn.lastConnectMs);
+  w.field("attempts", mqttConn.attempts);
+  w.field("failures", mqttConn.failures);
+  w.endObject();
+  jsonEnd(w);
 }
 
 void handleTestWiFi() {
-  String json = "{";
-  json += "\"ssid\":\"" + WiFi.SSID() + "\",";
-  json += "\"rssi\":" + String(WiFi.RSSI()) + ",";
-  json += "\"channel\":" + String(WiFi.channel()) + ",";
-  json += "\"ip\":\"" + WiFi.localIP().toString() + "\",";
-  json += "\"mac\":\"" + WiFi.macAddress() + "\",";
-  json += "\"hostname\":\"" + String(hostname) + "\"";
-  json += "}";
-  server.send(200, "application/json", json);
+  uint8_t mac[6];
+  char macStr[18];
+  WiFi.macAddress(mac);
+  snprintf(macStr, sizeof(macStr), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.field("ssid", WiFi.SSID().c_str());
+  w.field("rssi", WiFi.RSSI());
+  w.field("channel", WiFi.channel());
+  jsonIpField(w, "ip", WiFi.localIP());
+  w.field("mac", macStr);
+  w.field("hostname", hostname);
+  w.endObject();
+  jsonEnd(w);
 }
 
 void handleTestPing() {
   IPAddress gateway = WiFi.gatewayIP();
   bool reachable = Ping.ping(gateway, 1);
   
-  String json = "{";
-  json += "\"gateway\":\"" + gateway.toString() + "\",";
-  json += "\"reachable\":" + String(reachable ? "true" : "false") + ",";
-  json += "\"response_time\":\"" + String(reachable ? "<10ms" : "timeout") + "\",";
-  json += "\"dns\":\"" + WiFi.dnsIP().toString() + "\"";
-  json += "}";
-  server.send(200, "application/json", json);
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  jsonIpField(w, "gateway", gateway);
+  w.field("reachable", reachable);
+  w.field("response_time", reachable ? "<10ms" : "timeout");
+  jsonIpField(w, "dns", WiFi.dnsIP());
+  w.endObject();
+  jsonEnd(w);
+}
+
+// Erste 32 Bytes des zuletzt mitgeschnittenen Telegramms, erst bei Abruf formatiert
+void mbusLastCaptureHex(char* hex) {
+  MBusCaptureRecord rec;
+  hex[0] = '\0';
+  xSemaphoreTake(captureMutex, portMAX_DELAY);
+  bool ok = mbusCapture.get(mbusCapture.end() - 1, rec);
+  xSemaphoreGive(captureMutex);
+  if (!ok) return;
+  size_t dumpLen = min((size_t)rec.len, (size_t)32);
+  for (size_t i = 0; i < dumpLen; i++) {
+    snprintf(hex + 3 * i, 4, "%02X ", rec.data[i]);
+  }
+  strcpy(hex + 3 * dumpLen, rec.len > 32 ? "..." : "");
 }
 
 void handleMBusStats() {
-  String json = "{";
-  json += "\"total\":" + String(mbusStats.totalPolls) + ",";
-  json += "\"successful\":" + String(mbusStats.successfulPolls) + ",";
-  json += "\"total_time\":" + String(mbusStats.totalResponseTime) + ",";
-  json += "\"last_response\":" + String(mbusStats.lastResponseTime) + ",";
-  json += "\"hex_dump\":\"" + mbusStats.lastHexDump + "\"";
-  json += "}";
-  server.send(200, "application/json", json);
+  char hex[3 * 32 + 4];
+  mbusLastCaptureHex(hex);
+  
+  JsonWriter w = jsonBegin();
+  w.beginObject();
+  w.field("total", mbusStats.totalPolls);
+  w.field("successful", mbusStats.successfulPolls);
+  w.field("total_time", mbusStats.totalResponseTime);
+  w.field("last_response", mbusStats.lastResponseTime);
+  w.field("hex_dump", hex);
+  mbusLatencyJson(w);
+  if (lastReadingValid) {
+    w.key("meter");
+    w.beginObject();
+    w.field("serial", lastReading.serial);
+    w.field("address", lastReading.address);
+    w.field("status", lastReading.status);
+    w.field("access_no", lastReading.accessNo);
+    w.field("records", lastReading.records);
+    w.field("pages", lastReading.pages);
+    if (lastReading.hasTimestamp) {
+      char ts[20];
+      snprintf(ts, sizeof(ts), "%04d-%02d-%02dT%02d:%02d", lastReading.timestamp.year, lastReading.timestamp.month,
+               lastReading.timestamp.day, lastReading.timestamp.hour, lastReading.timestamp.minute);
+      w.field("meter_time", ts);
+    }
+    w.endObject();
+  }
+  w.field("scanning", mbusState == MBUS_SCAN_PRIMARY || mbusState == MBUS_SCAN_SECONDARY);
+  w.key("meters");
+  w.beginArray();
+  for (int i = 0; i < meterCount; i++) {
+    char idStr[9];
+    snprintf(idStr, sizeof(idStr), "%08lX", (unsigned long)meters[i].secondaryId);
+    w.beginObject();
+    w.field("address", meters[i].address);
+    w.field("secondary", meters[i].secondaryId ? idStr : "");
+    w.field("topic", meters[i].topics.topic);
+    w.field("volume", meters[i].lastVolume, 2);
+    w.field("total", meters[i].stats.totalPolls);
+    w.field("successful", meters[i].stats.successfulPolls);
+    w.field("last_response", meters[i].stats.lastResponseTime);
+    w.field("baud", meters[i].baud);
+    w.endObject();
+  }
+  w.endArray();
+  w.endObject();
+  jsonEnd(w);
+}
+
+void handleMBusCapture() {
+  // Binärer Mitschnitt, Format siehe mbus_capture.h; Auswertung mit tools/mbus_replay
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.sendHeader("Content-Disposition", "attachment; filename=\"mbus_capture.bin\"");
+  server.send(200, "application/octet-stream", "");
+  
+  uint8_t buf[MBUS_CAPTURE_RECORD_HEADER_LEN + MBUS_CAPTURE_MAX_FRAME];
+  server.sendContent((const char*)buf, mbusCaptureFileHeader(buf));
+  
+  xSemaphoreTake(captureMutex, portMAX_DELAY);
+  uint32_t seq = mbusCapture.first();
+  uint32_t end = mbusCapture.end();
+  xSemaphoreGive(captureMutex);
+  
+  // Record für Record kopieren, damit der M-Bus Task nie auf den Client warten muss
+  MBusCaptureRecord rec;
+  for (; seq < end; seq++) {
+    xSemaphoreTake(captureMutex, portMAX_DELAY);
+    bool ok = mbusCapture.get(seq, rec);
+    xSemaphoreGive(captureMutex);
+    if (!ok) continue; // inzwischen überschrieben
+    server.sendContent((const char*)buf, rec.serialize(buf));
+  }
+  server.sendContent("");
 }
 
 void handleMBusTrigger() {
   // Manuelle M-Bus Abfrage starten
-  if (mbusState == MBUS_IDLE) {
-    // Poll Frame senden
-    uint8_t pollFrame[5] = {0x10, 0x5B, 0x00, 0x5B, 0x16};
-    mbusSerial.write(pollFrame, sizeof(pollFrame));
-    mbusSerial.flush();
-    mbusLen = 0;
-    mbusLastAction = millis();
-    mbusState = MBUS_WAIT_RESPONSE;
+  if (mbusState == MBUS_IDLE && !mbusTriggerRequested) {
+    mbusTriggerRequested = true; // startet im M-Bus Task beim nächsten Durchlauf
     
     Serial.println(ANSI_YELLOW "M-Bus: Manuelle Abfrage gestartet" ANSI_RESET);
     server.send(200, "application/json", "{\"status\":\"triggered\",\"message\":\"M-Bus Abfrage gestartet\"}");
@@ -2644,13 +2951,53 @@ void handleMBusTrigger() {
   }
 }
 
+// Frischen Messwert anfordern. Liegt ein Ergebnis aus dem Koaleszenz-Fenster
+// vor, kommt es sofort; sonst 202 mit der Nummer des Zyklus, auf den die
+// Anfrage wartet. Den Stand fragt der Client mit ?id=<n> ab, der WebServer
+// blockiert dabei nie.
+void handleMBusRead() {
+  if (server.hasArg("id")) {
+    uint32_t id = queryArg("id", 0);
+    if (id != 0 && mbusReadCycle != 0 && (int32_t)(mbusReadCycle - id) >= 0) {
+      JsonWriter w = jsonBegin();
+      mbusReadJson(w, false, millis());
+      jsonEnd(w);
+    } else if (id != 0 && id == mbusReadTarget) {
+      server.send(202, "application/json", "{\"status\":\"pending\",\"id\":" + String(id) + "}");
+    } else {
+      server.send(504, "application/json", "{\"status\":\"timeout\",\"message\":\"Keine Antwort vom M-Bus\"}");
+    }
+    return;
+  }
+  switch (mbusReadAttach(millis())) {
+    case MBUS_READ_FRESH: {
+      JsonWriter w = jsonBegin();
+      mbusReadJson(w, true, millis());
+      jsonEnd(w);
+      break;
+    }
+    case MBUS_READ_PENDING:
+      server.sendHeader("Location", "/api/mbus/read?id=" + String(mbusReadTarget));
+      server.send(202, "application/json", "{\"status\":\"pending\",\"id\":" + String(mbusReadTarget) + "}");
+      break;
+    case MBUS_READ_BUSY:
+      server.send(409, "application/json", "{\"status\":\"busy\",\"message\":\"M-Bus Scan läuft\"}");
+      break;
+  }
+}
+
 void handleErrorReset() {
   // Fehlerstatistik zurücksetzen
   errorStats.mbusTimeouts = 0;
   errorStats.mbusParseErrors = 0;
+  errorStats.mbusRetries = 0;
   errorStats.mqttErrors = 0;
   errorStats.wifiDisconnects = 0;
   lastErrorMessage = "";
+  mbusSchedule.maxJitter = 0;
+  mbusLatency.publish.reset();
+  mbusLatency.total.reset();
+  mbusLatencyResetRequested = true; // Stufen des M-Bus Tasks setzt der Task selbst zurück
   
   Serial.println("Fehlerstatistik zurückgesetzt");
   server.send(200, "application/json", "{\"status\":\"ok\",\"message\":\"Fehlerstatistik zurückgesetzt\"}");
@@ -2736,6 +3083,45 @@ void handleConfigPost() {
       val.toCharArray(mqtt_topic, sizeof(mqtt_topic));
     }
     
+    idx = body.indexOf("\"mqtt_json\":");
+    if (idx >= 0) {
+      mqtt_json = body.substring(idx + 12, idx + 16) == "true";
+    }
+    
+    idx = body.indexOf("\"ha_device_discovery\":");
+    if (idx >= 0) {
+      ha_device_discovery = body.substring(idx + 22, idx + 26) == "true";
+    }
+    
+    idx = body.indexOf("\"pub_change_only\":");
+    if (idx >= 0) {
+      pub_change_only = body.substring(idx + 18, idx + 22) == "true";
+    }
+    
+    idx = body.indexOf("\"pub_heartbeat\":");
+    if (idx >= 0) {
+      int seconds = body.substring(idx + 16).toInt();
+      if (seconds >= 30 && seconds <= 3600) pub_heartbeat = (unsigned long)seconds * 1000UL;
+    }
+    
+    idx = body.indexOf("\"pub_volume_db\":");
+    if (idx >= 0) {
+      float v = body.substring(idx + 16).toFloat();
+      if (v >= 0 && v <= 10) pub_volume_db = v;
+    }
+    
+    idx = body.indexOf("\"pub_rssi_db\":");
+    if (idx >= 0) {
+      int v = body.substring(idx + 14).toInt();
+      if (v >= 0 && v <= 30) pub_rssi_db = v;
+    }
+    
+    idx = body.indexOf("\"pub_rate_db\":");
+    if (idx >= 0) {
+      float v = body.substring(idx + 14).toFloat();
+      if (v >= 0 && v <= 100) pub_rate_db = v;
+    }
+    
     idx = body.indexOf("\"poll_interval\":");
     if (idx >= 0) {
       int start = idx + 16; // Nach "poll_interval":
@@ -2801,6 +3187,40 @@ void handleConfigPost() {
       use_static_ip = body.substring(idx + 15, idx + 19) == "true";
     }
     
+    idx = body.indexOf("\"mbus_scan\":");
+    if (idx >= 0) {
+      mbus_scan_enabled = body.substring(idx + 12, idx + 16) == "true";
+    }
+    
+    idx = body.indexOf("\"poll_adaptive\":");
+    if (idx >= 0) {
+      poll_adaptive = body.substring(idx + 16, idx + 20) == "true";
+    }
+    
+    idx = body.indexOf("\"poll_min\":");
+    if (idx >= 0) {
+      int seconds = body.substring(idx + 11).toInt();
+      if (seconds >= 10 && seconds <= 300) poll_min = (unsigned long)seconds * 1000UL;
+    }
+    
+    idx = body.indexOf("\"poll_max\":");
+    if (idx >= 0) {
+      int seconds = body.substring(idx + 11).toInt();
+      if (seconds >= 10 && seconds <= 3600) poll_max = (unsigned long)seconds * 1000UL;
+    }
+    if (poll_max < poll_min) poll_max = poll_min;
+    
+    idx = body.indexOf("\"poll_align\":");
+    if (idx >= 0) {
+      poll_align = body.substring(idx + 13, idx + 17) == "true";
+    }
+    
+    idx = body.indexOf("\"mbus_baud\":");
+    if (idx >= 0) {
+      long baud = body.substring(idx + 12).toInt();
+      if (mbusBaudValid(baud)) mbus_baud = baud;
+    }
+    
     idx = body.indexOf("\"static_ip\":\"");
     if (idx >= 0) {
       int start = idx + 13;
@@ -2849,12 +3269,262 @@ void handleConfigPost() {
   }
 }
 
+// ---- Server-Sent Events (Push an die WebUI) ----
+// Offene Dashboards bekommen neue Messwerte, Log-Zeilen und Statusänderungen
+// über einen eigenen Port gepusht, statt /api/data und /api/logs zu pollen.
+// Der synchrone WebServer kann keine Verbindung offen halten (er nimmt nach
+// jeder Antwort 2 s lang keine neuen Clients an), daher ein eigener WiFiServer.
+// Jedes Ereignis wird einmal komplett formatiert und an alle Clients geschrieben:
+// die Last hängt an der Zahl der Ereignisse, nicht an der Zahl offener Dashboards.
+// Geschrieben wird nicht blockierend direkt auf den Socket; nimmt der
+// Sendepuffer das Ereignis nicht ganz auf, wird der Client getrennt, statt
+// loop() zu blockieren. Der Browser verbindet
+// sich neu und lädt beim "open" nach, was er verpasst hat.
+const uint16_t SSE_PORT = 81;
+const uint8_t SSE_MAX_CLIENTS = 4;
+const unsigned long SSE_HANDSHAKE_TIMEOUT = 2000;
+const unsigned long SSE_STATUS_CHECK = 1000;      // Status auf Änderungen prüfen
+const unsigned long SSE_STATUS_HEARTBEAT = 30000; // Status spätestens nach 30 s erneut senden
+const int SSE_RSSI_DEADBAND = 3;                  // dBm
+
+enum SseClientState { SSE_FREE, SSE_HANDSHAKE, SSE_OPEN };
+
+struct SseClient {
+  WiFiClient client;
+  SseClientState state;
+  unsigned long since;
+  char request[24];     // Anfang der Request-Zeile
+  uint8_t requestLen;
+  uint8_t headerEnd;    // Fortschritt beim Erkennen von "\r\n\r\n"
+};
+
+WiFiServer sseServer(SSE_PORT);
+SseClient sseClients[SSE_MAX_CLIENTS];
+uint8_t sseOpenClients = 0;
+char sseChunk[256];
+char sseEvent[1536];      // aktuelles Ereignis komplett (Status ~1 KB), passt in den TCP-Sendepuffer
+size_t sseEventLen = 0;
+bool sseEventOverflow = false;
+uint32_t sseLogSeq = 0;
+
+// Zuletzt gesendeter Status; ein neuer wird nur bei Änderung verschickt
+struct SseStatus {
+  bool wifi;
+  bool mqtt;
+  int rssi;
+  unsigned long lastUpdate;
+  unsigned long pollInterval;
+  unsigned long errors;
+  unsigned long polls;
+};
+SseStatus sseLastStatus;
+bool sseStatusForce = false;
+unsigned long sseStatusSent = 0;
+unsigned long sseStatusChecked = 0;
+
+void sseClose(SseClient& c) {
+  if (c.state == SSE_OPEN) sseOpenClients--;
+  c.client.stop();
+  c.state = SSE_FREE;
+}
+
+// Ganzes Ereignis an alle offenen Clients; wer es nicht ohne Warten aufnehmen
+// kann, hängt oder ist weg und wird getrennt. WiFiClient::write wartet bei
+// vollem Sendepuffer per select() bis zu Sekunden, daher send() mit
+// MSG_DONTWAIT auf dem Socket des Clients.
+void sseWrite(const char* data, size_t len) {
+  for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+    SseClient& c = sseClients[i];
+    if (c.state != SSE_OPEN) continue;
+    int fd = c.client.fd();
+    if (fd < 0 || send(fd, data, len, MSG_DONTWAIT) != (int)len) sseClose(c);
+  }
+}
+
+void sseAppend(const char* data, size_t len) {
+  if (sseEventLen + len > sizeof(sseEvent)) {
+    sseEventOverflow = true;
+    return;
+  }
+  memcpy(sseEvent + sseEventLen, data, len);
+  sseEventLen += len;
+}
+
+void sseSendChunk(void* ctx, const char* data, size_t len) {
+  sseAppend(data, len);
+}
+
+// Ereignis beginnen; Daten als einzeiliges JSON, der Writer maskiert Zeilenumbrüche
+JsonWriter sseEventBegin(const char* event) {
+  sseEventLen = 0;
+  sseEventOverflow = false;
+  sseAppend("event: ", 7);
+  sseAppend(event, strlen(event));
+  sseAppend("\ndata: ", 7);
+  return JsonWriter(sseChunk, sizeof(sseChunk), sseSendChunk, NULL);
+}
+
+void sseEventEnd(JsonWriter& w) {
+  w.flush();
+  sseAppend("\n\n", 2);
+  // Abgeschnittene Ereignisse nicht senden, sie würden den Stream zerstören
+  if (!sseEventOverflow) sseWrite(sseEvent, sseEventLen);
+}
+
+void sseSendReading(unsigned long timestamp, float volume) {
+  if (sseOpenClients == 0) return;
+  JsonWriter w = sseEventBegin("reading");
+  w.beginObject();
+  w.field("timestamp", timestamp);
+  w.field("volume", volume, 2);
+  w.field("max", MAX_MEASUREMENTS);
+  w.endObject();
+  sseEventEnd(w);
+}
+
+// Neue Log-Einträge einzeln kopieren und senden, damit addLog() im M-Bus Task
+// nie auf einen langsamen Client warten muss
+void sseSendLogs() {
+  while (true) {
+    char message[160];
+    unsigned long timestamp = 0;
+    bool pending = false;
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    uint32_t behind = logSeq - sseLogSeq;
+    if (behind > logBuffer.size()) {
+      // Aus dem Ringbuffer gefallene Einträge überspringen
+      behind = logBuffer.size();
+      sseLogSeq = logSeq - behind;
+    }
+    if (behind > 0) {
+      const LogEntry& e = logBuffer[logBuffer.size() - behind];
+      timestamp = e.timestamp;
+      strncpy(message, e.message.c_str(), sizeof(message) - 1);
+      message[sizeof(message) - 1] = '\0';
+      sseLogSeq++;
+      pending = true;
+    }
+    xSemaphoreGive(logMutex);
+    if (!pending) break;
+    JsonWriter w = sseEventBegin("log");
+    w.beginObject();
+    w.field("uptime", millis());
+    w.field("timestamp", timestamp);
+    w.field("message", message);
+    w.endObject();
+    sseEventEnd(w);
+  }
+}
+
+void sseSendStatus(unsigned long now) {
+  SseStatus s;
+  s.wifi = WiFi.status() == WL_CONNECTED;
+  s.mqtt = mqttConnected();
+  s.rssi = WiFi.RSSI();
+  s.lastUpdate = measurements.empty() ? 0 : measurements.back().timestamp;
+  s.pollInterval = mbusPollInterval;
+  s.errors = errorStats.mbusTimeouts + errorStats.mbusParseErrors + errorStats.mqttErrors + errorStats.wifiDisconnects;
+  s.polls = mbusStats.totalPolls;
+  bool changed = sseStatusForce || s.wifi != sseLastStatus.wifi || s.mqtt != sseLastStatus.mqtt ||
+                 abs(s.rssi - sseLastStatus.rssi) >= SSE_RSSI_DEADBAND || s.lastUpdate != sseLastStatus.lastUpdate ||
+                 s.pollInterval != sseLastStatus.pollInterval || s.errors != sseLastStatus.errors ||
+                 s.polls != sseLastStatus.polls;
+  if (!changed && now - sseStatusSent < SSE_STATUS_HEARTBEAT) return;
+  sseLastStatus = s;
+  sseStatusForce = false;
+  sseStatusSent = now;
+  JsonWriter w = sseEventBegin("status");
+  w.beginObject();
+  apiStatusJson(w);
+  w.endObject();
+  sseEventEnd(w);
+}
+
+// Request lesen, bis die Header vollständig sind; nur GET /api/events wird angenommen
+void sseHandshake(SseClient& c, unsigned long now) {
+  while (c.client.available() && c.headerEnd < 4) {
+    char ch = c.client.read();
+    if (c.requestLen < sizeof(c.request) - 1) c.request[c.requestLen++] = ch;
+    if (ch == (c.headerEnd % 2 == 0 ? '\r' : '\n')) c.headerEnd++;
+    else c.headerEnd = ch == '\r' ? 1 : 0;
+  }
+  if (c.headerEnd < 4) {
+    if (now - c.since >= SSE_HANDSHAKE_TIMEOUT || !c.client.connected()) sseClose(c);
+    return;
+  }
+  c.request[c.requestLen] = '\0';
+  if (strncmp(c.request, "GET /api/events", 15) != 0 || (c.request[15] != ' ' && c.request[15] != '?')) {
+    c.client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    sseClose(c);
+    return;
+  }
+  // Seite kommt von Port 80, daher CORS freigeben; retry: Wiederverbindung nach 5 s
+  c.client.print("HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/event-stream\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Connection: keep-alive\r\n"
+                 "Access-Control-Allow-Origin: *\r\n"
+                 "\r\n"
+                 "retry: 5000\n\n");
+  c.state = SSE_OPEN;
+  sseOpenClients++;
+  sseStatusForce = true; // neuer Client bekommt sofort den aktuellen Status
+}
+
+void sseService(unsigned long now) {
+  WiFiClient incoming = sseServer.available();
+  if (incoming) {
+    SseClient* slot = NULL;
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS && !slot; i++) {
+      if (sseClients[i].state == SSE_FREE) slot = &sseClients[i];
+    }
+    if (slot) {
+      slot->client = incoming;
+      slot->state = SSE_HANDSHAKE;
+      slot->since = now;
+      slot->requestLen = 0;
+      slot->headerEnd = 0;
+    } else {
+      // Alle Plätze belegt: Browser fällt auf Polling zurück
+      incoming.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+      incoming.stop();
+    }
+  }
+  
+  for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+    SseClient& c = sseClients[i];
+    if (c.state == SSE_HANDSHAKE) sseHandshake(c, now);
+    else if (c.state == SSE_OPEN && !c.client.connected()) sseClose(c);
+  }
+  
+  if (sseOpenClients == 0) {
+    // Niemand hört zu: nichts nachholen, wenn sich später jemand verbindet
+    sseLogSeq = logSeq;
+    return;
+  }
+  sseSendLogs();
+  if (sseStatusForce || now - sseStatusChecked >= SSE_STATUS_CHECK) {
+    sseStatusChecked = now;
+    sseSendStatus(now);
+  }
+}
+
+// ---- WebServer Setup ----
 void setupWebServer() {
   Serial.println("\n=== WebServer Setup Start ===");
   
   // Routen registrieren
   server.on("/", HTTP_GET, handleRoot);
+  
+  // JS-Bibliotheken (Chart.js) aus LittleFS, gzip-komprimiert; die Version steht im
+  // Dateinamen, daher dürfen Browser sie dauerhaft cachen
+  if (LittleFS.begin(false) && LittleFS.exists("/lib")) {
+    server.serveStatic("/lib/", LittleFS, "/lib/", "public, max-age=31536000, immutable");
+  } else {
+    addLog("LittleFS: Kein Dateisystem gefunden - Diagramm fehlt (pio run -t uploadfs)");
+  }
   server.on("/api/data", HTTP_GET, handleAPI);
+  server.on("/api/history", HTTP_GET, handleHistory);
   server.on("/api/config", HTTP_GET, handleConfigGet);
   server.on("/api/config", HTTP_POST, handleConfigPost);
   server.on("/api/wifi/scan", HTTP_GET, handleWifiScan);
@@ -2867,13 +3537,20 @@ void setupWebServer() {
   server.on("/api/test/ping", HTTP_GET, handleTestPing);
   server.on("/api/mbus/stats", HTTP_GET, handleMBusStats);
   server.on("/api/mbus/trigger", HTTP_POST, handleMBusTrigger);
+  server.on("/api/mbus/read", HTTP_GET, handleMBusRead);
+  server.on("/api/mbus/capture", HTTP_GET, handleMBusCapture);
   server.on("/api/errors/reset", HTTP_POST, handleErrorReset);
   
   // OTA Update über ArduinoOTA (Port 3232) - siehe ArduinoOTA.begin() in setup()
   // WebUI zeigt Anleitung für PlatformIO OTA Upload
   
+  // Request-Header werden nur gespeichert, wenn sie vorher angemeldet sind
+  static const char* headerKeys[] = {"If-None-Match"};
+  server.collectHeaders(headerKeys, 1);
+  
   // Server starten auf Port 80
   server.begin();
+  sseServer.begin();
   
   Serial.println("WebServer Routen registriert:");
   Serial.println("  GET  /");
@@ -2977,7 +3654,7 @@ void setup() {
   }
   
   client.setServer(mqtt_server, mqtt_port);
-  client.setBufferSize(512); // Grerer Buffer fr Discovery
+  client.setCallback(mqttCallback);
   
   // Client-ID mit MAC-Adresse fr Eindeutigkeit
   uint8_t mac[6];
@@ -2992,9 +3669,32 @@ void setup() {
   
   // M-Bus initialisieren
   mbusSerial.begin(MBUS_BAUD, SERIAL_8E1, MBUS_RX_PIN, MBUS_TX_PIN);
+  // Jedes Byte sofort an den Ringpuffer geben, sonst hält der UART-FIFO bis zu
+  // 120 Bytes zurück und Gap-Timer/Antwortzeiten wären verfälscht
+  mbusSerial.setRxFIFOFull(1);
+  mbusSerial.setRxTimeout(1);
   Serial.println("M-Bus UART bereit");
   
-  mbusLastAction = millis() - poll_interval; // sofort Poll starten
+  mbusPollInterval = poll_interval;
+  if (poll_adaptive) {
+    pollScheduler.begin(poll_min, poll_max, poll_interval);
+    mbusPollInterval = pollScheduler.interval();
+  }
+  
+  loadMeters();
+  outboxLoad();
+  if (mbus_scan_enabled) {
+    mbusStartScan();
+  } else {
+    mbusCycleStart = millis() - mbusPollInterval; // sofort Poll starten
+  }
+  
+  // Im AP-Modus wird wie bisher nicht gepollt
+  if (!apMode) {
+    xTaskCreatePinnedToCore(mbusTask, "mbus", MBUS_TASK_STACK, NULL, MBUS_TASK_PRIORITY, &mbusTaskHandle, MBUS_TASK_CORE);
+    Serial.println("M-Bus Task gestartet (Core " + String(MBUS_TASK_CORE) + ")");
+    xTaskCreatePinnedToCore(mqttTask, "mqtt", MQTT_TASK_STACK, NULL, MQTT_TASK_PRIORITY, &mqttTaskHandle, MQTT_TASK_CORE);
+  }
   
   addLog("Setup abgeschlossen - System bereit");
   Serial.println(ANSI_GREEN ANSI_BOLD "Setup abgeschlossen!" ANSI_RESET);
@@ -3007,6 +3707,7 @@ void loop() {
   if (apMode) {
     ArduinoOTA.handle();
     server.handleClient();
+    sseService(millis());
     updateStatusLED();
     return;
   }
@@ -3018,10 +3719,10 @@ void loop() {
     setup_wifi();
   }
   
-  if (!client.connected()) reconnect();
-  client.loop();
+  mqttManage(millis());
   ArduinoOTA.handle();
   server.handleClient();
+  sseService(millis());
   updateStatusLED();
   
   // Memory Check alle 60 Sekunden
@@ -3035,132 +3736,21 @@ void loop() {
   static unsigned long lastStatusPrint = 0;
   if (now - lastStatusPrint >= 60000) {
     Serial.println("\n[Status] WiFi: " + String(WiFi.status() == WL_CONNECTED ? "OK" : "FEHLER") + 
-                   " | MQTT: " + String(client.connected() ? "OK" : "FEHLER") +
+                   " | MQTT: " + String(mqttConnected() ? "OK" : "FEHLER") +
                    " | IP: " + WiFi.localIP().toString() +
                    " | Uptime: " + String(millis()/1000) + "s");
     lastStatusPrint = now;
   }
   
-  // Home Assistant Discovery senden (einmalig nach Connect)
-  if (client.connected() && !haDiscoverySent) {
-    sendHomeAssistantDiscovery();
-  }
-
-  switch (mbusState) {
-    case MBUS_IDLE:
-      if (now - mbusLastAction >= poll_interval) {
-        // Poll senden
-        uint8_t pollFrame[5] = {0x10, 0x5B, 0x00, 0x5B, 0x16};
-        mbusSerial.write(pollFrame, sizeof(pollFrame));
-        mbusSerial.flush();
-        mbusLen = 0;
-        mbusLastAction = now;
-        mbusState = MBUS_WAIT_RESPONSE;
-        Serial.println("MBUS Poll gesendet, warte auf Antwort...");
-        addLog("M-Bus: Poll gestartet");
-      }
-      break;
-
-    case MBUS_WAIT_RESPONSE:
-      while (mbusSerial.available() && mbusLen < sizeof(mbusBuffer)) {
-        mbusBuffer[mbusLen++] = mbusSerial.read();
-      }
+  // Home Assistant Discovery schrittweise senden
+  haDiscoveryProcess(now);
 
-      if ((now - mbusLastAction >= MBUS_RESPONSE_TIMEOUT) || mbusLen >= sizeof(mbusBuffer)) {
-        mbusStats.totalPolls++;
-        mbusStats.lastResponseTime = now - mbusLastAction;
-        mbusStats.totalResponseTime += mbusStats.lastResponseTime;
-        
-        if (mbusLen > 0) {
-          Serial.print("MBUS Antwort empfangen (");
-          Serial.print(mbusLen);
-          Serial.print(" Bytes, ");
-          Serial.print(mbusStats.lastResponseTime);
-          Serial.println("ms)");
-          addLog("M-Bus: Antwort erhalten (" + String(mbusLen) + " Bytes, " + String(mbusStats.lastResponseTime) + "ms)");
-          
-          // Hex Dump speichern
-          mbusStats.lastHexDump = "";
-          String hexLog = "";
-          for (size_t i = 0; i < min(mbusLen, (size_t)32); i++) {
-            char hex[4];
-            sprintf(hex, "%02X ", mbusBuffer[i]);
-            mbusStats.lastHexDump += hex;
-            hexLog += hex;
-          }
-          if (mbusLen > 32) hexLog += "...";
-          addLog("M-Bus: Rohdaten - " + hexLog);
-
-          float volume = parseGasVolumeBCD(mbusBuffer, mbusLen);
-          if (volume >= 0) {
-            mbusStats.successfulPolls++;
-            
-            // Durchschnittliche Antwortzeit berechnen
-            mbusStats.avgResponseTime = mbusStats.totalPolls > 0 ? 
-              (mbusStats.totalResponseTime / mbusStats.totalPolls) : 0;
-            
-            char payload[16];
-            dtostrf(volume, 0, 2, payload);
-            
-            // Volumen publishen (retained so Home Assistant always has latest state)
-            if (client.publish(mqtt_topic, payload, true)) {
-              Serial.print("Verbrauch gesendet: ");
-              Serial.println(payload);
-              addLog("M-Bus: Verbrauch OK - " + String(payload) + " m³");
-              
-              // Energie berechnen und publishen (für Energy Dashboard)
-              float energy_kwh = volume * gas_calorific_value * gas_correction_factor;
-              char energy_payload[16];
-              dtostrf(energy_kwh, 0, 1, energy_payload);
-              String energy_topic = String(mqtt_topic) + "_energy";
-              client.publish(energy_topic.c_str(), energy_payload, true); // retained!
-              Serial.print("Energie gesendet: ");
-              Serial.print(energy_payload);
-              Serial.println(" kWh");
-              addLog("MQTT: Energie - " + String(energy_payload) + " kWh (Zählerstand: " + String(payload) + " m³, Brennwert: " + String(gas_calorific_value, 6) + ", Z-Zahl: " + String(gas_correction_factor, 6) + ")");
-              
-              // Additional HA sensors (nach Energy-Publish)
-              String wifiTopic = String(mqtt_topic) + "_wifi";
-              client.publish(wifiTopic.c_str(), String(WiFi.RSSI()).c_str(), true); // retained!
-              
-              String rateTopic = String(mqtt_topic) + "_mbus_rate";
-              float rate = mbusStats.totalPolls > 0 ? (mbusStats.successfulPolls * 100.0 / mbusStats.totalPolls) : 0;
-              client.publish(rateTopic.c_str(), String(rate, 1).c_str(), true); // retained!
-            } else {
-              errorStats.mqttErrors++;
-              logError("MQTT Publish fehlgeschlagen");
-              addLog("MQTT: Publish Fehler");
-            }
-            
-            // Verlauf speichern mit echter Zeit wenn verfgbar
-            lastVolume = volume;
-            unsigned long timestamp = timeInitialized ? time(nullptr) : millis();
-            measurements.push_back({timestamp, volume});
-            if (measurements.size() > MAX_MEASUREMENTS) {
-              measurements.erase(measurements.begin());
-            }
-            
-            // Alle 10 Messungen persistieren
-            static int saveCounter = 0;
-            saveCounter++;
-            if (saveCounter >= 10) {
-              saveHistory();
-              saveCounter = 0;
-            }
-          } else {
-            Serial.println("Kein Volumenwert gefunden!");
-            errorStats.mbusParseErrors++;
-            logError("M-Bus Parse Fehler");
-          }
-        } else {
-          Serial.println("Keine MBUS Antwort erhalten");
-          errorStats.mbusTimeouts++;
-          logError("M-Bus Timeout");
-        }
-        mbusState = MBUS_IDLE; // wieder bereit fr nchsten Poll
-      }
-      break;
-  }
+  // Vom M-Bus Task dekodierte Messwerte veröffentlichen
+  timeSyncCheck();
+  mbusPublishPending();
+  mbusApplyMeterTable();
+  mbusReadService(millis());
+  outboxDrain(millis());
 }
 
 
@@ -0,0 +1,221 @@
+// ---- M-Bus Mitschnitt abspielen (Host-Tool) ----
+// Liest einen Mitschnitt von /api/mbus/capture, schickt jedes Telegramm durch
+// denselben Decoder wie die Firmware und gibt aus, was veröffentlicht würde:
+// Topics, Payloads und Totzonen kommen aus mqtt_payload.h wie in
+// mbusPublishReading. Mit -b wird der Decoder über alle Telegramme gebenchmarkt.
+//
+// Bauen:   g++ -std=c++11 -O2 -Iinclude tools/mbus_replay.cpp -o mbus_replay
+// Aufruf:  ./mbus_replay [-t topic] [-c brennwert] [-z z-zahl] [-j] [-s] [-w dbm] [-W topic]
+//                        [-o] [-v m3] [-r prozent] [-H sekunden] [-b runden] mbus_capture.bin
+//   -j  mqtt_json: ein Statustopic je Messung
+//   -s  Zähler > 0 sekundär adressiert (Topic mit Identnummer statt Primäradresse)
+//   -w  WLAN-Pegel für Zähler 0 (offline unbekannt, Standard -60 dBm), -W dessen Topic
+//   -o  pub_change_only mit Totzonen -v (Volumen), -r (M-Bus Rate), Heartbeat -H
+//
+// Adresse bzw. Identnummer für das Topic kommen aus der Antwort des Zählers.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "mbus_capture.h"
+#include "mbus_decoder.h"
+#include "mbus_receiver.h"
+#include "mqtt_payload.h"
+
+static const char* rxStatusText(uint8_t status) {
+  switch (status) {
+    case MBUS_RX_PENDING:  return "timeout";
+    case MBUS_RX_COMPLETE: return "complete";
+    case MBUS_RX_OVERFLOW: return "overflow";
+    case MBUS_RX_GAP:      return "gap";
+  }
+  return "?";
+}
+
+// Identnummer (dezimal) als BCD-Nibbles wie MBusMeter::secondaryId
+static uint32_t idToBcd(uint32_t id) {
+  uint32_t bcd = 0;
+  for (int shift = 0; shift < 32; shift += 4, id /= 10) bcd |= (uint32_t)(id % 10) << shift;
+  return bcd;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* topic = "gaszaehler/verbrauch";
+  const char* wifiTopic = "gaszaehler/verbrauch_wifi";
+  // Standardwerte wie in der Firmware
+  MqttPublishConfig cfg;
+  cfg.json = false;
+  cfg.changeOnly = false;
+  cfg.heartbeatMs = 300000;
+  cfg.volumeDb = 0;
+  cfg.rateDb = 1.0f;
+  cfg.rssiDb = 3;
+  cfg.calorific = 10.0f;
+  cfg.correction = 1.0f;
+  bool secondary = false;
+  int rssi = -60;
+  int benchRounds = 0;
+  const char* path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) topic = argv[++i];
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc) cfg.calorific = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-z") && i + 1 < argc) cfg.correction = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-j")) cfg.json = true;
+    else if (!strcmp(argv[i], "-s")) secondary = true;
+    else if (!strcmp(argv[i], "-W") && i + 1 < argc) wifiTopic = argv[++i];
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc) rssi = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o")) cfg.changeOnly = true;
+    else if (!strcmp(argv[i], "-v") && i + 1 < argc) cfg.volumeDb = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) cfg.rateDb = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-H") && i + 1 < argc) cfg.heartbeatMs = strtoul(argv[++i], NULL, 10) * 1000UL;
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) benchRounds = atoi(argv[++i]);
+    else path = argv[i];
+  }
+  if (!path) {
+    fprintf(stderr, "Aufruf: %s [-t topic] [-c brennwert] [-z z-zahl] [-j] [-s] [-w dbm] [-W topic] [-o] [-v m3] [-r prozent] "
+                    "[-H sekunden] [-b runden] mbus_capture.bin\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> file;
+  if (!readFile(path, file)) {
+    fprintf(stderr, "%s: kann nicht gelesen werden\n", path);
+    return 1;
+  }
+  if (!mbusCaptureCheckHeader(file.data(), file.size())) {
+    fprintf(stderr, "%s: kein Mitschnitt (Kopf MBCP v%u erwartet)\n", path, MBUS_CAPTURE_VERSION);
+    return 1;
+  }
+
+  std::vector<MBusCaptureRecord> records;
+  size_t pos = MBUS_CAPTURE_FILE_HEADER_LEN;
+  while (pos < file.size()) {
+    MBusCaptureRecord rec;
+    size_t used = rec.parse(file.data() + pos, file.size() - pos);
+    if (used == 0) {
+      fprintf(stderr, "%s: Record bei Offset %zu abgeschnitten\n", path, pos);
+      break;
+    }
+    records.push_back(rec);
+    pos += used;
+  }
+
+  // Abspielen: pro Zähler eine Sitzung, Folgeseiten (DIF 0x1F) werden zusammengeführt
+  MBusGasReading sessions[256];
+  bool open[256] = {false};
+  // Je Zähler wie MBusMeter: Poll-Statistik für mbus_rate und Totzonen-Filter
+  unsigned polls[256] = {0}, successful[256] = {0};
+  DeadbandFilter volumeFilters[256], rateFilters[256], rssiFilter;
+  unsigned published = 0, suppressed = 0, errors = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    const MBusCaptureRecord& rec = records[i];
+    printf("#%zu t=%u ms=%u zaehler=%u %u Bytes (%s)\n", i, rec.unixTime, rec.millis, rec.meter, rec.len,
+           rxStatusText(rec.status));
+    MBusGasReading& session = sessions[rec.meter];
+    if (!open[rec.meter]) mbusBeginGasReading(session);
+    bool more;
+    MBusDecodeResult r = mbusDecodeGasPage(rec.data, rec.len, session, more);
+    if (r != MBUS_DECODE_OK) {
+      printf("  verworfen: %s\n", mbusDecodeResultText(r));
+      open[rec.meter] = false;
+      polls[rec.meter]++;
+      errors++;
+      continue;
+    }
+    if (more) {
+      printf("  Seite %u, weitere folgen\n", session.pages);
+      open[rec.meter] = true;
+      continue;
+    }
+    open[rec.meter] = false;
+    polls[rec.meter]++;
+    if (!session.hasVolume) {
+      printf("  verworfen: %s\n", mbusDecodeResultText(MBUS_DECODE_NO_VOLUME));
+      errors++;
+      continue;
+    }
+    successful[rec.meter]++;
+
+    MqttMeterTopics topics;
+    mqttBuildMeterTopics(topics, topic, rec.meter, session.address, secondary ? idToBcd(session.serial) : 0);
+    MqttReadingValues v;
+    v.volume = session.volume;
+    v.energy = mqttEnergyKwh(session.volume, cfg);
+    v.rate = successful[rec.meter] * 100.0 / polls[rec.meter];
+    v.hasRssi = rec.meter == 0;
+    v.rssi = rssi;
+    MqttPublishDue due = mqttPublishDue(cfg, v, volumeFilters[rec.meter], rateFilters[rec.meter], rssiFilter, rec.millis);
+    char payload[160];
+    if (cfg.json) {
+      if (due.any()) {
+        mqttFormatState(payload, sizeof(payload), v);
+        printf("  %s %s\n", topics.state, payload);
+        volumeFilters[rec.meter].published(v.volume, rec.millis);
+        rateFilters[rec.meter].published(v.rate, rec.millis);
+        if (v.hasRssi) rssiFilter.published(v.rssi, rec.millis);
+      }
+    } else {
+      if (due.volume) {
+        mqttFormatVolume(payload, sizeof(payload), v.volume);
+        printf("  %s %s\n", topics.topic, payload);
+        mqttFormatEnergy(payload, sizeof(payload), v.energy);
+        printf("  %s %s\n", topics.energy, payload);
+        volumeFilters[rec.meter].published(v.volume, rec.millis);
+      }
+      if (due.rssi) {
+        mqttFormatRssi(payload, sizeof(payload), v.rssi);
+        printf("  %s %s\n", wifiTopic, payload);
+        rssiFilter.published(v.rssi, rec.millis);
+      }
+      if (due.rate) {
+        mqttFormatRate(payload, sizeof(payload), v.rate);
+        printf("  %s %s\n", topics.rate, payload);
+        rateFilters[rec.meter].published(v.rate, rec.millis);
+      }
+    }
+    if (due.any()) {
+      published++;
+    } else {
+      printf("  unterdrueckt (Totzone)\n");
+      suppressed++;
+    }
+    if (session.hasTimestamp) {
+      printf("  Zaehlerzeit %04d-%02d-%02dT%02d:%02d\n", session.timestamp.year, session.timestamp.month,
+             session.timestamp.day, session.timestamp.hour, session.timestamp.minute);
+    }
+  }
+  printf("%zu Telegramme, %u Messwerte (%u unterdrueckt), %u verworfen\n", records.size(), published, suppressed, errors);
+
+  if (benchRounds > 0 && !records.empty()) {
+    size_t bytes = 0;
+    unsigned ok = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int round = 0; round < benchRounds; round++) {
+      for (size_t i = 0; i < records.size(); i++) {
+        MBusGasReading reading;
+        bool more;
+        mbusBeginGasReading(reading);
+        if (mbusDecodeGasPage(records[i].data, records[i].len, reading, more) == MBUS_DECODE_OK) ok++;
+        bytes += records[i].len;
+      }
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t frames = records.size() * benchRounds;
+    printf("Benchmark: %zu Telegramme in %.3f s = %.0f Telegramme/s, %.1f MB/s, %.0f ns/Telegramm (%u gueltig)\n",
+           frames, s, frames / s, bytes / s / 1e6, s * 1e9 / frames, ok);
+  }
+  return errors > 0 ? 1 : 0;
+}